@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "config.h"
+
+// times the intersection, sampling and shading hot paths and prints the results as json
+int run_micro_benchmarks();
+
+struct ScalingOptions {
+	std::string scene = "cornell_box";
+	int max_threads = 0; // 0 goes up to every hardware thread
+	int size = 400;
+	int samples_base = 1;
+	bool csv = false;
+};
+
+// renders a standard scene at 1..max_threads threads with a fixed (strong) and a per thread (weak) workload
+int run_scaling_benchmark(const ScalingOptions &options);
+
+struct ConvergenceOptions {
+	std::string scene = "cornell_box";
+	std::string reference_path; // defaults to a file named after the scene and settings
+	int size = 200;
+	int reference_samples = 32;
+	int max_samples = 8;
+	int max_depth = Config{}.max_depth;
+	int ambient_occlusion_samples = Config{}.ambient_occlusion_samples;
+};
+
+// renders with growing sample budgets and prints the error against a high sample reference over time as csv
+int run_convergence_benchmark(const ConvergenceOptions &options);
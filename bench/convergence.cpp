@@ -0,0 +1,114 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bench.h"
+#include "config.h"
+#include "render.h"
+#include "scenes.h"
+
+// keeps relMSE finite for black reference pixels
+static constexpr double kRelMseEpsilon = 1e-2;
+
+struct Frame {
+	std::vector<glm::vec3> colors;
+	double ms;
+};
+
+static Frame render_frame(const SceneEntry &entry, const Scene &scene, const Config &cfg) {
+	auto cam = entry.make_camera();
+	init_camera(cam, cfg.width, cfg.height);
+
+	Frame frame{.colors = std::vector<glm::vec3>(cfg.width * cfg.height)};
+	std::vector<char> pixels(cfg.width * cfg.height * 3);
+	RenderingTask task{
+			.cfg = cfg,
+			.cam = cam,
+			.scene = scene,
+
+			.pixel_buffer = pixels.data(),
+			.color_buffer = frame.colors.data(),
+	};
+	generate_image(task);
+
+	frame.ms = task.duration_ms;
+	return frame;
+}
+
+static bool load_reference(const std::string &path, std::vector<glm::vec3> &colors) {
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if (!in || in.tellg() != static_cast<std::streamoff>(colors.size() * sizeof(glm::vec3))) return false;
+
+	in.seekg(0);
+	in.read(reinterpret_cast<char *>(colors.data()), static_cast<std::streamsize>(colors.size() * sizeof(glm::vec3)));
+	return static_cast<bool>(in);
+}
+
+static void save_reference(const std::string &path, const std::vector<glm::vec3> &colors) {
+	std::ofstream out(path, std::ios::binary);
+	out.write(reinterpret_cast<const char *>(colors.data()),
+			  static_cast<std::streamsize>(colors.size() * sizeof(glm::vec3)));
+}
+
+int run_convergence_benchmark(const ConvergenceOptions &options) {
+	auto entry = find_scene(options.scene);
+	if (!entry) {
+		std::cerr << "unknown scene: " << options.scene << std::endl;
+		return 1;
+	}
+
+	Scene scene;
+	entry->make_scene(scene);
+
+	auto cfg = Config{
+			.width = options.size,
+			.height = options.size,
+			.max_depth = options.max_depth,
+			.ambient_occlusion_samples = options.ambient_occlusion_samples,
+	};
+
+	auto reference_path = options.reference_path;
+	if (reference_path.empty()) {
+		reference_path = "convergence_" + options.scene + "_" + std::to_string(options.size) + "_" +
+						 std::to_string(options.reference_samples) + "_d" + std::to_string(cfg.max_depth) +
+						 "_ao" + std::to_string(cfg.ambient_occlusion_samples) + ".ref";
+	}
+
+	// the reference is the expensive part, so it is rendered once and reused by later runs
+	std::vector<glm::vec3> reference(cfg.width * cfg.height);
+	if (!load_reference(reference_path, reference)) {
+		auto reference_cfg = cfg;
+		reference_cfg.samples_base = options.reference_samples;
+		std::cerr << "rendering reference at " << options.reference_samples * options.reference_samples << " spp"
+				  << std::endl;
+		reference = render_frame(*entry, scene, reference_cfg).colors;
+		save_reference(reference_path, reference);
+	}
+
+	std::cout << "scene,samples_base,spp,ms,rmse,relmse\n";
+	for (auto samples = 1; samples <= options.max_samples; ++samples) {
+		cfg.samples_base = samples;
+		auto frame = render_frame(*entry, scene, cfg);
+
+		auto squared = 0.0;
+		auto relative = 0.0;
+		for (auto i = 0; i < reference.size(); ++i) {
+			for (auto c = 0; c < 3; ++c) {
+				auto ref = static_cast<double>(reference[i][c]);
+				auto diff = static_cast<double>(frame.colors[i][c]) - ref;
+				squared += diff * diff;
+				relative += diff * diff / (ref * ref + kRelMseEpsilon);
+			}
+		}
+
+		auto n = static_cast<double>(reference.size() * 3);
+		std::cout << options.scene << "," << samples << "," << samples * samples << "," << frame.ms << ","
+				  << glm::sqrt(squared / n) << "," << relative / n << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+
+static void print_usage() {
+	std::cerr << "usage: raytracer_bench [micro]\n"
+			  << "       raytracer_bench scaling [--scene name] [--max-threads n] [--size pixels] [--samples n] [--csv]"
+			  << "\n"
+			  << "       raytracer_bench convergence [--scene name] [--size pixels] [--reference-samples n]\n"
+			  << "                                   [--max-samples n] [--depth n] [--ao n] [--reference file]"
+			  << std::endl;
+}
+
+int main(int argc, char **argv) {
+	std::string mode = argc > 1 ? argv[1] : "micro";
+
+	if (mode == "micro") return run_micro_benchmarks();
+
+	if (mode == "scaling") {
+		ScalingOptions options;
+		for (auto i = 2; i < argc; ++i) {
+			auto has_value = i + 1 < argc;
+			if (!strcmp(argv[i], "--csv")) options.csv = true;
+			else if (!strcmp(argv[i], "--scene") && has_value) options.scene = argv[++i];
+			else if (!strcmp(argv[i], "--max-threads") && has_value) options.max_threads = std::stoi(argv[++i]);
+			else if (!strcmp(argv[i], "--size") && has_value) options.size = std::stoi(argv[++i]);
+			else if (!strcmp(argv[i], "--samples") && has_value) options.samples_base = std::stoi(argv[++i]);
+			else {
+				print_usage();
+				return 1;
+			}
+		}
+		return run_scaling_benchmark(options);
+	}
+
+	if (mode == "convergence") {
+		ConvergenceOptions options;
+		for (auto i = 2; i < argc; ++i) {
+			auto has_value = i + 1 < argc;
+			if (!strcmp(argv[i], "--scene") && has_value) options.scene = argv[++i];
+			else if (!strcmp(argv[i], "--size") && has_value) options.size = std::stoi(argv[++i]);
+			else if (!strcmp(argv[i], "--reference-samples") && has_value)
+				options.reference_samples = std::stoi(argv[++i]);
+			else if (!strcmp(argv[i], "--max-samples") && has_value) options.max_samples = std::stoi(argv[++i]);
+			else if (!strcmp(argv[i], "--depth") && has_value) options.max_depth = std::stoi(argv[++i]);
+			else if (!strcmp(argv[i], "--ao") && has_value) options.ambient_occlusion_samples = std::stoi(argv[++i]);
+			else if (!strcmp(argv[i], "--reference") && has_value) options.reference_path = argv[++i];
+			else {
+				print_usage();
+				return 1;
+			}
+		}
+		return run_convergence_benchmark(options);
+	}
+
+	print_usage();
+	return 1;
+}
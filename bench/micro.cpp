@@ -0,0 +1,211 @@
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bench.h"
+#include "camera.h"
+#include "config.h"
+#include "context.h"
+#include "math.h"
+#include "ray.h"
+#include "scene.h"
+#include "scenes.h"
+
+// every benchmark draws its inputs from generators seeded with this, so runs are comparable between releases
+static constexpr unsigned int kSeed = 1337;
+static constexpr std::size_t kInputCount = 4096;
+static constexpr auto kMinDuration = std::chrono::milliseconds(250);
+
+struct BenchResult {
+	std::string name;
+	double ns_per_op;
+	double mrays_per_s; // negative if the benchmark does not trace rays
+};
+
+template<class T>
+static inline void do_not_optimize(const T &value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// runs op over batches of kInputCount calls until kMinDuration passed, op returns the number of rays it traced
+static BenchResult run(const std::string &name, const std::function<std::size_t(std::size_t)> &op) {
+	using clock = std::chrono::steady_clock;
+
+	// warm up caches and branch predictors
+	for (std::size_t i = 0; i < kInputCount; ++i) op(i);
+
+	std::size_t ops = 0;
+	std::size_t rays = 0;
+	auto start = clock::now();
+	auto elapsed = clock::duration::zero();
+
+	while (elapsed < kMinDuration) {
+		for (std::size_t i = 0; i < kInputCount; ++i) rays += op(i);
+		ops += kInputCount;
+		elapsed = clock::now() - start;
+	}
+
+	auto ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	return BenchResult{
+			.name = name,
+			.ns_per_op = ns / static_cast<double>(ops),
+			.mrays_per_s = rays > 0 ? static_cast<double>(rays) / ns * 1e3 : -1.0,
+	};
+}
+
+static std::vector<Ray> random_rays(std::mt19937 &g, const glm::vec3 &target, float spread) {
+	std::uniform_real_distribution<float> d(-1.f, 1.f);
+	std::vector<Ray> rays;
+	for (std::size_t i = 0; i < kInputCount; ++i) {
+		glm::vec3 origin = {d(g) * 10.f, d(g) * 10.f, -20.f};
+		glm::vec3 aim = target + glm::vec3(d(g), d(g), d(g)) * spread;
+		rays.push_back(Ray{.origin = origin, .direction = glm::normalize(aim - origin)});
+	}
+	return rays;
+}
+
+// scene with count primitives, half spheres and half rects, scattered in front of the benchmark rays
+static Scene random_scene(std::mt19937 &g, int count) {
+	std::uniform_real_distribution<float> d(-8.f, 8.f);
+	Scene scene;
+	for (auto i = 0; i < count; ++i) {
+		glm::vec3 pos = {d(g), d(g), d(g) * .5f + 10.f};
+		if (i % 2 == 0) {
+			add_sphere(scene, Sphere{.position = pos, .radius = 1.f}, make_mat_lambert({1, 1, 1}));
+		} else {
+			auto normal = glm::normalize(glm::vec3(d(g), d(g), -8.f));
+			auto tangent = glm::normalize(glm::cross(normal, glm::vec3(0, 1, 0)));
+			add_plane(scene, make_mat_lambert({1, 1, 1}), make_rect(pos, normal, tangent, {2, 2}));
+		}
+	}
+	return scene;
+}
+
+static void print_json(const std::vector<BenchResult> &results) {
+	std::cout << "{\n\t\"seed\": " << kSeed << ",\n\t\"benchmarks\": [\n";
+	for (std::size_t i = 0; i < results.size(); ++i) {
+		const auto &r = results[i];
+		std::cout << "\t\t{\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.ns_per_op;
+		if (r.mrays_per_s >= 0) std::cout << ", \"mrays_per_s\": " << r.mrays_per_s;
+		std::cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	std::cout << "\t]\n}" << std::endl;
+}
+
+int run_micro_benchmarks() {
+	std::mt19937 g(kSeed);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	std::vector<BenchResult> results;
+
+	// intersection
+	{
+		auto rays = random_rays(g, {0, 0, 0}, 2.f);
+		auto sphere = Sphere{.position = {0, 0, 0}, .radius = 1.5f};
+		auto plane = make_rect({0, 0, 0}, glm::normalize(glm::vec3(0, .3f, -1)), {1, 0, 0}, {3, 3});
+
+		results.push_back(run("intersect_sphere", [&](std::size_t i) {
+			do_not_optimize(intersect_sphere(rays[i], sphere));
+			return 1;
+		}));
+		results.push_back(run("intersect_plane", [&](std::size_t i) {
+			do_not_optimize(intersect_plane(rays[i], plane));
+			return 1;
+		}));
+	}
+
+	for (auto count : {8, 32, 128, 512}) {
+		auto scene = random_scene(g, count);
+		auto rays = random_rays(g, {0, 0, 10}, 8.f);
+		const RenderContext context;
+		Stats stats;
+
+		results.push_back(run("hit_scene/" + std::to_string(count), [&](std::size_t i) {
+			do_not_optimize(hit_scene(rays[i], scene, context, stats));
+			return 1;
+		}));
+	}
+
+	// sampling
+	{
+		std::vector<glm::vec2> u;
+		std::vector<glm::vec3> normals;
+		for (std::size_t i = 0; i < kInputCount; ++i) {
+			u.emplace_back(unit(g), unit(g));
+			normals.push_back(glm::normalize(glm::vec3(unit(g) - .5f, unit(g), unit(g) - .5f)));
+		}
+
+		results.push_back(run("uniform_sample_hemisphere", [&](std::size_t i) {
+			do_not_optimize(uniform_sample_hemisphere(u[i].x, u[i].y));
+			return 0;
+		}));
+		results.push_back(run("align_tbn", [&](std::size_t i) {
+			auto tangent = glm::normalize(glm::cross(normals[i], glm::vec3(1, 0, 0)));
+			do_not_optimize(align_tbn(normals[(i + 1) % kInputCount], normals[i], tangent));
+			return 0;
+		}));
+	}
+
+	// shading
+	{
+		auto cam = make_cornell_box_camera();
+		auto material = Material{
+				.type = MaterialType::kBlinnPhong,
+				.color = {1, 1, 1},
+				.blinnPhong = {
+						.diffuse_intensity = 1.f,
+						.specular_intensity = 1.f,
+						.shininess = 16.f,
+				},
+		};
+
+		std::vector<HitRecord> hits;
+		std::vector<glm::vec3> to_light;
+		for (std::size_t i = 0; i < kInputCount; ++i) {
+			auto normal = glm::normalize(glm::vec3(unit(g) - .5f, unit(g), unit(g) - .5f));
+			hits.push_back(HitRecord{
+					.position = {unit(g) * 10.f - 5.f, unit(g) * 10.f, unit(g) * 10.f - 5.f},
+					.normal = normal,
+					.tangent = glm::normalize(glm::cross(normal, glm::vec3(1, 0, 0))),
+					.front_facing = true,
+					.material = &material,
+			});
+			to_light.push_back(glm::normalize(glm::vec3(unit(g) - .5f, 1.f, unit(g) - .5f)));
+		}
+
+		results.push_back(run("blinn_phong", [&](std::size_t i) {
+			do_not_optimize(blinn_phong(hits[i], cam, to_light[i]));
+			return 0;
+		}));
+	}
+
+	// full integrator on the default scene, rays include all shadow, ambient occlusion and indirect rays
+	{
+		auto cfg = Config{};
+		auto cam = make_cornell_box_camera();
+		init_camera(cam, cfg.width, cfg.height);
+
+		Scene scene;
+		make_cornell_box(scene);
+		auto kernel = select_ray_color(scene, cfg);
+
+		std::vector<Ray> rays;
+		for (std::size_t i = 0; i < kInputCount; ++i)
+			rays.push_back(ray_from_camera(cam, unit(g), unit(g)));
+
+		const RenderContext context;
+		Stats stats;
+		results.push_back(run("ray_color", [&](std::size_t i) {
+			auto before = stats.ray_count;
+			do_not_optimize(kernel(rays[i], cam, scene, cfg, context, stats, cfg.max_depth));
+			return stats.ray_count - before;
+		}));
+	}
+
+	print_json(results);
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bench.h"
+#include "config.h"
+#include "render.h"
+#include "scenes.h"
+
+struct ScalingRow {
+	const char *mode;
+	int threads;
+	int width;
+	int height;
+
+	double ms;
+	double speedup;
+	double efficiency;
+	double mrays_per_s;
+
+	// averages over all render threads
+	double idle_ms;
+	double tile_wait_ms;
+};
+
+// the camera frames the scene as for a framing_height tall frame, whatever the height of cfg
+static ScalingRow render_once(const SceneEntry &entry, const Scene &scene, const Config &cfg, int framing_height,
+							  const char *mode) {
+	auto cam = entry.make_camera();
+	init_camera(cam, cfg.width, framing_height);
+
+	std::vector<char> pixels(cfg.width * cfg.height * 3);
+	RenderingTask task{
+			.cfg = cfg,
+			.cam = cam,
+			.scene = scene,
+
+			.pixel_buffer = pixels.data(),
+	};
+	generate_image(task);
+
+	auto row = ScalingRow{
+			.mode = mode,
+			.threads = cfg.threads,
+			.width = cfg.width,
+			.height = cfg.height,
+			.ms = task.duration_ms,
+			.mrays_per_s = task.stats.ray_count / task.duration_ms / 1e3,
+	};
+	for (const auto &times : task.thread_times) {
+		row.idle_ms += times.idle_ms / cfg.threads;
+		row.tile_wait_ms += times.tile_wait_ms / cfg.threads;
+	}
+	return row;
+}
+
+static void print_csv(const std::string &scene, const std::vector<ScalingRow> &rows) {
+	std::cout << "scene,mode,threads,width,height,ms,speedup,efficiency,mrays_per_s,idle_ms,tile_wait_ms\n";
+	for (const auto &r : rows) {
+		std::cout << scene << "," << r.mode << "," << r.threads << "," << r.width << "," << r.height << ","
+				  << r.ms << "," << r.speedup << "," << r.efficiency << "," << r.mrays_per_s << ","
+				  << r.idle_ms << "," << r.tile_wait_ms << "\n";
+	}
+	std::cout.flush();
+}
+
+static void print_json(const std::string &scene, const std::vector<ScalingRow> &rows) {
+	std::cout << "{\n\t\"scene\": \"" << scene << "\",\n\t\"runs\": [\n";
+	for (std::size_t i = 0; i < rows.size(); ++i) {
+		const auto &r = rows[i];
+		std::cout << "\t\t{\"mode\": \"" << r.mode << "\", \"threads\": " << r.threads
+				  << ", \"width\": " << r.width << ", \"height\": " << r.height
+				  << ", \"ms\": " << r.ms << ", \"speedup\": " << r.speedup << ", \"efficiency\": " << r.efficiency
+				  << ", \"mrays_per_s\": " << r.mrays_per_s
+				  << ", \"idle_ms\": " << r.idle_ms << ", \"tile_wait_ms\": " << r.tile_wait_ms << "}"
+				  << (i + 1 < rows.size() ? "," : "") << "\n";
+	}
+	std::cout << "\t]\n}" << std::endl;
+}
+
+int run_scaling_benchmark(const ScalingOptions &options) {
+	auto entry = find_scene(options.scene);
+	if (!entry) {
+		std::cerr << "unknown scene: " << options.scene << std::endl;
+		return 1;
+	}
+
+	Scene scene;
+	entry->make_scene(scene);
+
+	auto base_cfg = Config{
+			.width = options.size,
+			.height = options.size,
+			.samples_base = options.samples_base,
+	};
+	auto max_threads = options.max_threads > 0 ? options.max_threads : render_thread_count(Config{});
+
+	std::vector<ScalingRow> rows;
+
+	// strong scaling: the same frame split over more threads, ideal time is t1 / n
+	auto strong_start = rows.size();
+	for (auto threads = 1; threads <= max_threads; ++threads) {
+		auto cfg = base_cfg;
+		cfg.threads = threads;
+		auto row = render_once(*entry, scene, cfg, cfg.height, "strong");
+
+		auto t1 = threads == 1 ? row.ms : rows[strong_start].ms;
+		row.speedup = t1 / row.ms;
+		row.efficiency = row.speedup / threads;
+		rows.push_back(row);
+	}
+
+	// weak scaling: every thread gets a full frame worth of rows, ideal time stays t1. the rows sample the framing of
+	// the base frame more densely, so the scene and the work per row stay what they are with one thread
+	auto weak_start = rows.size();
+	for (auto threads = 1; threads <= max_threads; ++threads) {
+		auto cfg = base_cfg;
+		cfg.threads = threads;
+		cfg.height = base_cfg.height * threads;
+		auto row = render_once(*entry, scene, cfg, base_cfg.height, "weak");
+
+		auto t1 = threads == 1 ? row.ms : rows[weak_start].ms;
+		row.efficiency = t1 / row.ms;
+		row.speedup = row.efficiency * threads;
+		rows.push_back(row);
+	}
+
+	if (options.csv) print_csv(options.scene, rows);
+	else print_json(options.scene, rows);
+
+	return 0;
+}
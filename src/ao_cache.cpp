@@ -0,0 +1,64 @@
+#include "ao_cache.h"
+
+#include <glm/glm.hpp>
+
+// steps per axis a normal is quantized to, normals within about 20 degrees share cells
+static constexpr float kNormalSteps = 2.f;
+
+AmbientOcclusionCache::AmbientOcclusionCache(float cell_size, int confidence)
+		: inverse_cell_size(1.f / cell_size), confidence(static_cast<std::uint32_t>(glm::max(confidence, 1))) {}
+
+AmbientOcclusionCache::CellKey AmbientOcclusionCache::cell_key(const glm::vec3 &position,
+															   const glm::vec3 &normal) const {
+	auto cell = glm::floor(position * inverse_cell_size);
+	auto direction = glm::floor(normal * kNormalSteps + .5f);
+
+	CellKey key;
+	for (auto axis = 0; axis < 3; ++axis) {
+		key.cell[axis] = static_cast<std::int64_t>(cell[axis]);
+		key.direction[axis] = static_cast<std::int8_t>(direction[axis]);
+	}
+	return key;
+}
+
+// neighbouring cells differ by one in a single axis, every step multiplies to spread that over all bits
+std::size_t AmbientOcclusionCache::CellHash::operator()(const CellKey &key) const {
+	std::uint64_t hash = 0;
+	auto mix = [&hash](std::uint64_t value) {
+		hash = (hash ^ value) * 0x9e3779b97f4a7c15ull;
+		hash ^= hash >> 32;
+	};
+	for (auto axis = 0; axis < 3; ++axis) mix(static_cast<std::uint64_t>(key.cell[axis]));
+	mix(static_cast<std::uint8_t>(key.direction[0]) | static_cast<std::uint8_t>(key.direction[1]) << 8 |
+		static_cast<std::uint8_t>(key.direction[2]) << 16);
+	return hash;
+}
+
+static int shard_index(std::size_t hash) {
+	return static_cast<int>(hash >> 58);
+}
+
+bool AmbientOcclusionCache::lookup(const glm::vec3 &position, const glm::vec3 &normal, float &occlusion) {
+	auto key = cell_key(position, normal);
+	auto hash = CellHash{}(key);
+	auto &shard = shards[shard_index(hash)];
+
+	const std::lock_guard guard(shard.mutex);
+	auto it = shard.cells.find(key);
+	if (it == shard.cells.end() || it->second.samples < confidence) return false;
+	occlusion = it->second.occlusion_sum / static_cast<float>(it->second.samples);
+	return true;
+}
+
+float AmbientOcclusionCache::add(const glm::vec3 &position, const glm::vec3 &normal, float occlusion_sum,
+								 int samples) {
+	auto key = cell_key(position, normal);
+	auto hash = CellHash{}(key);
+	auto &shard = shards[shard_index(hash)];
+
+	const std::lock_guard guard(shard.mutex);
+	auto &cell = shard.cells[key];
+	cell.occlusion_sum += occlusion_sum;
+	cell.samples += samples;
+	return cell.occlusion_sum / static_cast<float>(cell.samples);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include <glm/vec3.hpp>
+
+// running ambient occlusion estimates per cell of a spatial hash, keyed on the position quantized to the cell size and
+// the normal quantized to a few directions. shading points in a cell share its estimate once it holds enough samples,
+// which blurs occlusion over a cell but saves every ray after that. shared by all render threads of a frame
+class AmbientOcclusionCache {
+public:
+	AmbientOcclusionCache(float cell_size, int confidence);
+
+	// the estimate of the cell at position and normal, false while it holds fewer than confidence samples
+	bool lookup(const glm::vec3 &position, const glm::vec3 &normal, float &occlusion);
+
+	// adds samples rays worth of occlusion, summed over the rays, and returns the new estimate of the cell
+	float add(const glm::vec3 &position, const glm::vec3 &normal, float occlusion_sum, int samples);
+
+private:
+	struct Cell {
+		float occlusion_sum = 0;
+		std::uint32_t samples = 0;
+	};
+
+	// the full grid cell and normal bucket, cells only share an estimate if they are the same cell
+	struct CellKey {
+		std::array<std::int64_t, 3> cell;
+		std::array<std::int8_t, 3> direction;
+
+		bool operator==(const CellKey &) const = default;
+	};
+	struct CellHash {
+		std::size_t operator()(const CellKey &key) const;
+	};
+
+	// shards keep threads that shade different cells from waiting on each other
+	struct Shard {
+		std::mutex mutex;
+		std::unordered_map<CellKey, Cell, CellHash> cells;
+	};
+	static constexpr int kShards = 64;
+
+	CellKey cell_key(const glm::vec3 &position, const glm::vec3 &normal) const;
+
+	float inverse_cell_size;
+	std::uint32_t confidence;
+	std::array<Shard, kShards> shards;
+};
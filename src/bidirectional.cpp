@@ -0,0 +1,427 @@
+#include "bidirectional.h"
+
+#include <array>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "config.h"
+#include "context.h"
+#include "math.h"
+#include "scene.h"
+
+// subpaths stop after this many bounces, whatever cfg.max_depth asks for
+static constexpr int kMaxBounces = kStatsMaxBounces;
+// a camera subpath holds the camera, a vertex per bounce and the emitter it may end on
+static constexpr int kMaxVertices = kMaxBounces + 2;
+
+// fixed point scale of the splats
+static constexpr double kSplatScale = 1 << 24;
+
+enum class VertexKind : unsigned char {
+	kCamera = 0,
+	kLight, // first vertex of a light subpath
+	kSurface,
+	kEmitter, // unlit surface a camera subpath ended on
+};
+
+struct PathVertex {
+	VertexKind kind;
+	glm::vec3 position;
+	glm::vec3 normal; // front of the surface, forward for the camera
+	glm::vec3 beta; // throughput of the subpath up to and including the vertex
+
+	const Material *material = nullptr; // for kSurface
+	glm::vec3 emission{0}; // radiance of kLight and kEmitter
+	int light = -1; // area light of kLight and kEmitter, emitters that are no area light keep -1
+
+	// densities over area of sampling the vertex from the end of its own subpath and from the other end
+	float pdf_fwd = 0;
+	float pdf_rev = 0;
+};
+
+using Subpath = std::array<PathVertex, kMaxVertices>;
+
+LightImage::LightImage(int width, int height) : channels(std::size_t(width) * height * 3) {}
+
+void LightImage::splat(int index, const glm::vec3 &value) {
+	for (auto c = 0; c < 3; ++c) {
+		auto fixed = static_cast<std::int64_t>(std::llround(value[c] * kSplatScale));
+		if (fixed != 0) std::atomic_ref(channels[index * 3 + c]).fetch_add(fixed, std::memory_order_relaxed);
+	}
+}
+
+void LightImage::resolve(glm::vec3 *colors) const {
+	auto count = paths.load();
+	if (count == 0) return;
+	auto scale = 1. / (kSplatScale * count);
+	for (std::size_t i = 0; i < channels.size() / 3; ++i) {
+		for (auto c = 0; c < 3; ++c) colors[i][c] += static_cast<float>(channels[i * 3 + c] * scale);
+	}
+}
+
+static float luminance(const glm::vec3 &color) {
+	return (color.x + color.y + color.z) / 3.f;
+}
+
+// any unit vector perpendicular to normal, align_tbn needs an orthonormal frame
+static glm::vec3 perpendicular(const glm::vec3 &normal) {
+	auto axis = glm::abs(normal.x) > .9f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+	return glm::normalize(glm::cross(axis, normal));
+}
+
+static glm::vec3 sample_cosine(const glm::vec3 &normal) {
+	auto dir = uniform_sample_hemisphere(rand_float(), rand_float());
+	return glm::normalize(align_tbn(dir, normal, perpendicular(normal)));
+}
+
+static int plane_index(const Scene &scene, EntityId id) {
+	for (auto i = 0; i < scene.planes.size(); ++i)
+		if (scene.planes[i].id == id) return i;
+	return -1;
+}
+
+static glm::vec3 light_radiance(const Scene &scene, int light) {
+	const auto &data = scene.area_light_data[light];
+	auto plane = plane_index(scene, scene.area_lights[light].id);
+	auto color = plane >= 0 ? scene.plane_materials[plane].color : glm::vec3(1);
+	return data.color * data.intensity * color;
+}
+
+static float light_area(const Scene &scene, int light) {
+	const auto &plane = scene.area_lights[light];
+	return plane.width * plane.height;
+}
+
+// lights are picked by power, infinite ones never
+static float light_power(const Scene &scene, int light) {
+	auto area = light_area(scene, light);
+	return std::isfinite(area) ? luminance(light_radiance(scene, light)) * area : 0.f;
+}
+
+static float light_pick_pdf(const Scene &scene, int light) {
+	auto total = 0.f;
+	for (auto i = 0; i < scene.area_lights.size(); ++i) total += light_power(scene, i);
+	return total > 0.f ? light_power(scene, light) / total : 0.f;
+}
+
+// density over area of a light subpath starting at v, an emitter
+static float light_origin_pdf(const Scene &scene, const PathVertex &v) {
+	if (v.light < 0) return 0.f;
+	return light_pick_pdf(scene, v.light) / light_area(scene, v.light);
+}
+
+// radiance of the unlit surface at hit, sets light to the area light it belongs to
+static glm::vec3 emitted_radiance(const Scene &scene, const Hit &hit, const Material &material, int &light) {
+	light = -1;
+	if (hit.kind != PrimitiveKind::kPlane) return material.color;
+	auto id = scene.planes[hit.index].id;
+	for (auto i = 0; i < scene.area_lights.size(); ++i) {
+		if (scene.area_lights[i].id != id) continue;
+		light = i;
+		return light_radiance(scene, i);
+	}
+	return material.color;
+}
+
+// image plane coordinates the camera sees position at, false if it lies behind the camera
+static bool project(const Camera &cam, const glm::vec3 &position, float &u, float &v, float &cos_theta) {
+	auto forward = glm::normalize(cam.look_at - cam.position);
+	auto dir = glm::normalize(position - cam.position);
+	cos_theta = glm::dot(dir, forward);
+	if (cos_theta <= 0.f) return false;
+
+	// the image plane is at distance one, see init_camera
+	auto offset = cam.position + dir / cos_theta - cam.lower_left_corner;
+	u = glm::dot(offset, cam.span_horizontal) / glm::dot(cam.span_horizontal, cam.span_horizontal);
+	v = glm::dot(offset, cam.span_vertical) / glm::dot(cam.span_vertical, cam.span_vertical);
+	return true;
+}
+
+static float image_area(const Camera &cam) {
+	return glm::length(cam.span_horizontal) * glm::length(cam.span_vertical);
+}
+
+// density over solid angle of the camera sampling the direction to position, the image plane is sampled uniformly
+static float camera_pdf(const Camera &cam, const glm::vec3 &position) {
+	float u, v, cos_theta;
+	if (!project(cam, position, u, v, cos_theta) || u < 0.f || u >= 1.f || v < 0.f || v >= 1.f) return 0.f;
+	return 1.f / (image_area(cam) * cos_theta * cos_theta * cos_theta);
+}
+
+// blinn phong as a reciprocal brdf. wo and wi point away from v, the back of a surface is black
+static glm::vec3 brdf(const PathVertex &v, const glm::vec3 &wo, const glm::vec3 &wi) {
+	if (glm::dot(v.normal, wo) <= 0.f || glm::dot(v.normal, wi) <= 0.f) return glm::vec3(0);
+	const auto &mat = v.material->blinnPhong;
+	auto value = mat.diffuse_intensity;
+	if (mat.shininess > 0.f) {
+		auto half_way = glm::normalize(wo + wi);
+		value += mat.specular_intensity * glm::pow(glm::max(glm::dot(v.normal, half_way), 0.f), mat.shininess);
+	}
+	return v.material->color * (value / PI);
+}
+
+// density over solid angle to density over the area around to
+static float to_area(float pdf, const PathVertex &from, const PathVertex &to) {
+	auto d = to.position - from.position;
+	auto distance2 = glm::dot(d, d);
+	if (distance2 == 0.f) return 0.f;
+	auto cos_to = to.kind == VertexKind::kCamera ? 1.f : glm::abs(glm::dot(to.normal, d)) / glm::sqrt(distance2);
+	return pdf * cos_to / distance2;
+}
+
+// density over area of v sampling next. surfaces sample and lights emit cosine weighted, whatever came before
+static float vertex_pdf(const Camera &cam, const PathVertex &v, const PathVertex &next) {
+	if (v.kind == VertexKind::kCamera) return to_area(camera_pdf(cam, next.position), v, next);
+	auto dir = glm::normalize(next.position - v.position);
+	return to_area(glm::max(0.f, glm::dot(v.normal, dir)) / PI, v, next);
+}
+
+static bool unoccluded(const Scene &scene, const glm::vec3 &from, const glm::vec3 &to, const RenderContext &context,
+					   Stats &stats, int bounce) {
+	auto d = to - from;
+	auto distance = glm::length(d);
+	++stats.shadow_rays[bounce];
+	if (!hit_scene(secondary_ray(from, d / distance), scene, context, stats, distance - 2.f * EPSILON)) return true;
+	++stats.shadow_hits[bounce];
+	return false;
+}
+
+// extends path, which holds count vertices, along ray until it holds max_vertices. pdf is the density of ray over
+// solid angle and beta the throughput along it. returns the new vertex count
+static int random_walk(const Scene &scene, Ray ray, glm::vec3 beta, float pdf, Subpath &path, int count,
+					   int max_vertices, bool from_camera, const RenderContext &context, Stats &stats) {
+	while (count < max_vertices) {
+		auto closest = hit_scene(ray, scene, context, stats);
+		if (!closest) break;
+		auto hit = surface_attributes(ray, scene, *closest);
+		// like ray_color the backs of surfaces are black
+		if (!hit.front_facing) break;
+
+		auto &prev = path[count - 1];
+		auto &v = path[count];
+		v = PathVertex{
+				.kind = VertexKind::kSurface,
+				.position = hit.position,
+				.normal = hit.normal,
+				.beta = beta,
+				.material = hit.material,
+		};
+		v.pdf_fwd = to_area(pdf, prev, v);
+
+		// unlit surfaces do not reflect, camera subpaths end on them and light subpaths have nothing to connect
+		if (hit.material->type == MaterialType::kUnlit) {
+			if (!from_camera) break;
+			v.kind = VertexKind::kEmitter;
+			v.emission = emitted_radiance(scene, *closest, *hit.material, v.light);
+			++count;
+			break;
+		}
+		if (++count == max_vertices) break;
+
+		auto wo = -ray.direction;
+		auto wi = sample_cosine(hit.normal);
+		auto cos_i = glm::dot(hit.normal, wi);
+		if (cos_i <= 0.f) break;
+		pdf = cos_i / PI;
+		beta *= brdf(v, wo, wi) * (cos_i / pdf);
+		prev.pdf_rev = to_area(glm::max(0.f, glm::dot(hit.normal, wo)) / PI, v, prev);
+		ray = secondary_ray(hit.position, wi);
+	}
+	return count;
+}
+
+static int light_subpath(const Scene &scene, Subpath &path, int max_vertices, const RenderContext &context,
+						 Stats &stats) {
+	auto total = 0.f;
+	for (auto i = 0; i < scene.area_lights.size(); ++i) total += light_power(scene, i);
+	if (total <= 0.f) return 0;
+
+	auto light = -1;
+	auto pick = rand_float() * total;
+	for (auto i = 0; i < scene.area_lights.size() && pick >= 0.f; ++i) {
+		auto power = light_power(scene, i);
+		if (power <= 0.f) continue;
+		light = i;
+		pick -= power;
+	}
+
+	const auto &plane = scene.area_lights[light];
+	auto position = plane.position + plane.bi_tangent * ((rand_float() - .5f) * plane.width) +
+					plane.tangent * ((rand_float() - .5f) * plane.height);
+	auto pdf_position = light_power(scene, light) / total / light_area(scene, light);
+	auto radiance = light_radiance(scene, light);
+
+	path[0] = PathVertex{
+			.kind = VertexKind::kLight,
+			.position = position,
+			.normal = plane.normal,
+			.beta = radiance / pdf_position,
+			.emission = radiance,
+			.light = light,
+			.pdf_fwd = pdf_position,
+	};
+
+	// the cosine of a lambert emitter cancels against the cosine weighted pdf
+	auto dir = sample_cosine(plane.normal);
+	auto pdf = glm::max(0.f, glm::dot(plane.normal, dir)) / PI;
+	if (pdf <= 0.f) return 1;
+	return random_walk(scene, secondary_ray(position, dir), radiance * PI / pdf_position, pdf, path, 1, max_vertices,
+					   false, context, stats);
+}
+
+// balance heuristic weight of the path made of s light and t camera vertices among every other split of it. the
+// reverse densities of the vertices next to the connection depend on it and are swapped in while the weight is taken
+static float mis_weight(const Scene &scene, const Camera &cam, Subpath &light, int s, Subpath &eye, int t) {
+	if (s + t == 2) return 1.f;
+
+	auto *qs = s > 0 ? &light[s - 1] : nullptr;
+	auto *pt = &eye[t - 1];
+	auto *qs_minus = s > 1 ? &light[s - 2] : nullptr;
+	auto *pt_minus = t > 1 ? &eye[t - 2] : nullptr;
+
+	std::array<float, 4> saved = {pt->pdf_rev, pt_minus ? pt_minus->pdf_rev : 0.f, qs ? qs->pdf_rev : 0.f,
+								  qs_minus ? qs_minus->pdf_rev : 0.f};
+	pt->pdf_rev = qs ? vertex_pdf(cam, *qs, *pt) : light_origin_pdf(scene, *pt);
+	if (pt_minus) pt_minus->pdf_rev = vertex_pdf(cam, *pt, *pt_minus);
+	if (qs) qs->pdf_rev = vertex_pdf(cam, *pt, *qs);
+	if (qs_minus) qs_minus->pdf_rev = vertex_pdf(cam, *qs, *qs_minus);
+
+	// a split whose vertices cannot all be sampled from the other side has a ratio of zero, and so have the splits
+	// past it
+	auto ratio = [](const PathVertex &v) { return v.pdf_fwd > 0.f ? v.pdf_rev / v.pdf_fwd : 0.f; };
+	auto sum = 0.f;
+	auto r = 1.f;
+	for (auto i = t - 1; i > 0; --i) {
+		r *= ratio(eye[i]);
+		sum += r;
+	}
+	r = 1.f;
+	for (auto i = s - 1; i >= 0; --i) {
+		r *= ratio(light[i]);
+		sum += r;
+	}
+
+	pt->pdf_rev = saved[0];
+	if (pt_minus) pt_minus->pdf_rev = saved[1];
+	if (qs) qs->pdf_rev = saved[2];
+	if (qs_minus) qs_minus->pdf_rev = saved[3];
+	return 1.f / (1.f + sum);
+}
+
+// unweighted contribution of connecting light vertex s - 1 to camera vertex t - 1, both past the endpoints
+static glm::vec3 connect(const Scene &scene, const Subpath &light, int s, const Subpath &eye, int t,
+						 const RenderContext &context, Stats &stats) {
+	const auto &qs = light[s - 1];
+	const auto &pt = eye[t - 1];
+	if (pt.kind != VertexKind::kSurface) return glm::vec3(0);
+
+	auto d = qs.position - pt.position;
+	auto distance2 = glm::dot(d, d);
+	auto w = d / glm::sqrt(distance2);
+
+	auto f_pt = brdf(pt, glm::normalize(eye[t - 2].position - pt.position), w);
+	auto f_qs = qs.kind == VertexKind::kLight
+				? glm::vec3(glm::dot(qs.normal, -w) > 0.f ? 1.f : 0.f)
+				: brdf(qs, glm::normalize(light[s - 2].position - qs.position), -w);
+	auto contribution = pt.beta * f_pt * f_qs * qs.beta;
+	if (luminance(contribution) <= 0.f) return glm::vec3(0);
+
+	auto g = glm::dot(pt.normal, w) * glm::abs(glm::dot(qs.normal, w)) / distance2;
+	auto bounce = glm::min(t - 2, kStatsMaxBounces - 1);
+	if (!unoccluded(scene, pt.position, qs.position, context, stats, bounce)) return glm::vec3(0);
+	return contribution * g;
+}
+
+// connects light vertex s - 1 to the camera and splats what it sees of it
+static void splat_to_camera(const Scene &scene, const Camera &cam, const Config &cfg, Subpath &light, int s,
+							Subpath &eye, const RenderContext &context, Stats &stats) {
+	const auto &qs = light[s - 1];
+	float u, v, cos_theta;
+	if (!project(cam, qs.position, u, v, cos_theta)) return;
+	auto x = static_cast<int>(std::floor(u * cfg.width));
+	auto y = static_cast<int>(std::floor(v * cfg.height));
+	if (x < 0 || x >= cfg.width || y < 0 || y >= cfg.height) return;
+
+	auto d = cam.position - qs.position;
+	auto distance2 = glm::dot(d, d);
+	auto w = d / glm::sqrt(distance2);
+	auto f = brdf(qs, glm::normalize(light[s - 2].position - qs.position), w);
+	if (luminance(f) <= 0.f) return;
+
+	// importance of the pixel, it integrates to one over the pixel the way its camera samples average
+	auto pixel_area = image_area(cam) / (static_cast<float>(cfg.width) * cfg.height);
+	auto importance = 1.f / (pixel_area * cos_theta * cos_theta * cos_theta * cos_theta);
+	auto g = glm::dot(qs.normal, w) * cos_theta / distance2;
+	if (!unoccluded(scene, qs.position, cam.position, context, stats, 0)) return;
+
+	auto weight = mis_weight(scene, cam, light, s, eye, 1);
+	context.light_image->splat((cfg.height - y - 1) * cfg.width + x, qs.beta * f * (g * importance * weight));
+}
+
+// light the directional lights give pt, they are delta lights only next event estimation finds
+static glm::vec3 directional_light(const Scene &scene, const Subpath &eye, int t, const RenderContext &context,
+								   Stats &stats) {
+	const auto &pt = eye[t - 1];
+	auto wo = glm::normalize(eye[t - 2].position - pt.position);
+	auto bounce = glm::min(t - 2, kStatsMaxBounces - 1);
+
+	glm::vec3 color(0);
+	for (const auto &l : scene.directional_lights) {
+		auto f = brdf(pt, wo, -l.direction);
+		if (luminance(f) <= 0.f) continue;
+		++stats.shadow_rays[bounce];
+		if (hit_scene(secondary_ray(pt.position, -l.direction), scene, context, stats)) {
+			++stats.shadow_hits[bounce];
+			continue;
+		}
+		color += pt.beta * f * l.color * (l.intensity * glm::dot(pt.normal, -l.direction));
+	}
+	return color;
+}
+
+glm::vec3 bidirectional_color(const Ray &ray, const Camera &camera, const Scene &scene, const Config &cfg,
+							  const RenderContext &context, Stats &stats, int max_depth) {
+	auto depth = glm::clamp(max_depth, 1, kMaxBounces);
+
+	Subpath eye;
+	eye[0] = PathVertex{
+			.kind = VertexKind::kCamera,
+			.position = camera.position,
+			.normal = glm::normalize(camera.look_at - camera.position),
+			.beta = glm::vec3(1),
+			.pdf_fwd = 1,
+	};
+	auto pdf = camera_pdf(camera, ray_at(ray, 1.f));
+	auto eye_count = random_walk(scene, ray, glm::vec3(1), pdf, eye, 1, depth + 2, true, context, stats);
+	++stats.path_length[glm::min(eye_count - 1, kStatsMaxBounces)];
+
+	Subpath light;
+	auto light_count = light_subpath(scene, light, depth + 1, context, stats);
+	if (context.light_image) context.light_image->add_path();
+
+	glm::vec3 color(0);
+	for (auto t = 2; t <= eye_count; ++t) {
+		if (eye[t - 1].kind == VertexKind::kSurface && t - 1 <= depth)
+			color += directional_light(scene, eye, t, context, stats);
+
+		for (auto s = 0; s <= light_count && s + t - 2 <= depth; ++s) {
+			glm::vec3 contribution;
+			if (s == 0) {
+				const auto &pt = eye[t - 1];
+				if (pt.kind != VertexKind::kEmitter) continue;
+				contribution = pt.beta * pt.emission;
+			} else {
+				contribution = connect(scene, light, s, eye, t, context, stats);
+			}
+			if (luminance(contribution) > 0.f) color += contribution * mis_weight(scene, camera, light, s, eye, t);
+		}
+	}
+
+	// the light subpath seen straight through the camera, the light itself only comes from camera subpaths
+	if (context.light_image) {
+		for (auto s = 2; s <= light_count; ++s) splat_to_camera(scene, camera, cfg, light, s, eye, context, stats);
+	}
+	return color;
+}
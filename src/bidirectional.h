@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "ray.h"
+
+// bidirectional path tracing after veach. every camera sample also traces a subpath from an area light, chosen by
+// power, and connects every vertex of one subpath to every vertex of the other. the strategies are weighed by the
+// balance heuristic, connections to the camera are splatted into context.light_image.
+//
+// unlike ray_color the light transport is physically based and nothing is clamped per bounce: area lights are lambert
+// emitters of their color times intensity times the color of their plane, other unlit surfaces emit their color,
+// directional lights give an irradiance of intensity times color and blinn phong surfaces reflect by a reciprocal
+// brdf, the highlight taken around the half way vector of both directions instead of the camera. ambient occlusion,
+// lightmaps, caches and guiding are left to ray_color. the same scene therefore comes out darker than with ray_color,
+// area lights fall off with distance here
+glm::vec3 bidirectional_color(const Ray &ray, const struct Camera &camera, const Scene &scene,
+							  const struct Config &cfg, const struct RenderContext &context, Stats &stats,
+							  int max_depth);
+
+// sums the light tracing splats of a frame. splats are added in fixed point, so the sum does not depend on the order
+// threads add them in
+class LightImage {
+public:
+	LightImage(int width, int height);
+
+	// adds value to the pixel at index, in the order of the pixel buffer. safe to call from several threads
+	void splat(int index, const glm::vec3 &value);
+
+	// counts a light subpath, traced or not. splats are averaged over all of them
+	void add_path() { paths.fetch_add(1, std::memory_order_relaxed); }
+
+	// adds the average splat of every pixel to colors
+	void resolve(glm::vec3 *colors) const;
+
+private:
+	std::vector<std::int64_t> channels; // three per pixel
+	std::atomic<std::uint64_t> paths = 0;
+};
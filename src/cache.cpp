@@ -0,0 +1,183 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include "hash.h"
+
+namespace fs = std::filesystem;
+
+static constexpr char kCacheMagic[4] = {'R', 'T', 'C', 'A'};
+// part of every key, bump it whenever the kernels change what a pixel comes out as
+static constexpr std::int64_t kCacheVersion = 2;
+
+struct CacheEntryHeader {
+	char magic[4];
+	std::int32_t width;
+	std::int32_t height;
+};
+
+static std::string entry_name(const ContentHash &hash, const char *extension) {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016" PRIx64 ".%s", hash.value, extension);
+	return name;
+}
+
+// a frame depends on its tile size through the tile seeds, a tile only on its rect
+static std::string frame_entry(std::uint64_t render_hash, int tile_size) {
+	ContentHash key;
+	key.add(kCacheVersion);
+	key.add(static_cast<std::int64_t>(render_hash));
+	key.add(static_cast<std::int64_t>(tile_size));
+	return entry_name(key, "frame");
+}
+
+static std::string tile_entry(std::uint64_t render_hash, const glm::ivec4 &rect) {
+	ContentHash key;
+	key.add(kCacheVersion);
+	key.add(static_cast<std::int64_t>(render_hash));
+	key.add(rect);
+	return entry_name(key, "tile");
+}
+
+RenderCache::RenderCache(std::string dir, std::uint64_t max_bytes) : dir(std::move(dir)), max_bytes(max_bytes) {
+	std::error_code error;
+	fs::create_directories(this->dir, error);
+
+	std::vector<std::pair<fs::file_time_type, fs::directory_entry>> found;
+	for (const auto &entry : fs::directory_iterator(this->dir, error)) {
+		auto extension = entry.path().extension();
+		if (entry.is_regular_file() && (extension == ".frame" || extension == ".tile"))
+			found.emplace_back(entry.last_write_time(), entry);
+	}
+	std::sort(found.begin(), found.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+	for (const auto &[time, entry] : found) {
+		auto name = entry.path().filename().string();
+		recent.push_back(name);
+		entries[name] = {entry.file_size(), std::prev(recent.end())};
+		total_bytes += entry.file_size();
+	}
+	evict();
+}
+
+bool RenderCache::load_frame(std::uint64_t render_hash, int tile_size, int width, int height,
+							 std::vector<glm::vec3> &colors) {
+	auto hit = load(frame_entry(render_hash, tile_size), width, height, colors);
+	const std::lock_guard guard(mutex);
+	++(hit ? counts.frame_hits : counts.frame_misses);
+	return hit;
+}
+
+void RenderCache::store_frame(std::uint64_t render_hash, int tile_size, int width, int height,
+							  const glm::vec3 *colors) {
+	store(frame_entry(render_hash, tile_size), width, height, colors);
+}
+
+bool RenderCache::load_tile(std::uint64_t render_hash, const glm::ivec4 &rect, std::vector<glm::vec3> &colors) {
+	auto hit = load(tile_entry(render_hash, rect), rect.z - rect.x, rect.w - rect.y, colors);
+	const std::lock_guard guard(mutex);
+	++(hit ? counts.tile_hits : counts.tile_misses);
+	return hit;
+}
+
+void RenderCache::store_tile(std::uint64_t render_hash, const glm::ivec4 &rect, const std::vector<glm::vec3> &colors) {
+	store(tile_entry(render_hash, rect), rect.z - rect.x, rect.w - rect.y, colors.data());
+}
+
+RenderCache::Report RenderCache::report() {
+	const std::lock_guard guard(mutex);
+	return counts;
+}
+
+bool RenderCache::load(const std::string &name, int width, int height, std::vector<glm::vec3> &colors) {
+	{
+		const std::lock_guard guard(mutex);
+		if (!entries.contains(name)) return false;
+	}
+
+	// the file can be evicted by another thread in the meantime, that is just a miss
+	std::ifstream in(fs::path(dir) / name, std::ios::binary);
+	CacheEntryHeader header;
+	if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+		!std::equal(kCacheMagic, kCacheMagic + 4, header.magic) || header.width != width || header.height != height)
+		return false;
+
+	colors.resize(width * height);
+	auto size = static_cast<std::streamsize>(colors.size() * sizeof(glm::vec3));
+	if (!in.read(reinterpret_cast<char *>(colors.data()), size)) return false;
+
+	touch(name);
+	const std::lock_guard guard(mutex);
+	counts.bytes_read += sizeof(header) + size;
+	return true;
+}
+
+void RenderCache::store(const std::string &name, int width, int height, const glm::vec3 *colors) {
+	auto path = fs::path(dir) / name;
+	auto tmp_path = path;
+	tmp_path += ".tmp";
+
+	auto header = CacheEntryHeader{.width = width, .height = height};
+	std::copy_n(kCacheMagic, 4, header.magic);
+	auto colors_size = static_cast<std::streamsize>(width * height * sizeof(glm::vec3));
+	auto size = sizeof(header) + colors_size;
+	{
+		std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char *>(colors), colors_size);
+		if (!out.flush()) return;
+	}
+
+	std::error_code error;
+	fs::rename(tmp_path, path, error);
+	if (error) return;
+
+	const std::lock_guard guard(mutex);
+	auto it = entries.find(name);
+	if (it != entries.end()) {
+		total_bytes -= it->second.first;
+		recent.erase(it->second.second);
+	}
+	recent.push_front(name);
+	entries[name] = {size, recent.begin()};
+	total_bytes += size;
+	counts.bytes_written += size;
+	evict();
+}
+
+void RenderCache::touch(const std::string &name) {
+	std::error_code error;
+	fs::last_write_time(fs::path(dir) / name, fs::file_time_type::clock::now(), error);
+
+	const std::lock_guard guard(mutex);
+	auto it = entries.find(name);
+	if (it == entries.end()) return;
+	recent.splice(recent.begin(), recent, it->second.second);
+}
+
+// callers hold mutex, the most recent entry always stays
+void RenderCache::evict() {
+	while (total_bytes > max_bytes && recent.size() > 1) {
+		auto name = recent.back();
+		recent.pop_back();
+		total_bytes -= entries[name].first;
+		entries.erase(name);
+		++counts.evictions;
+
+		std::error_code error;
+		fs::remove(fs::path(dir) / name, error);
+	}
+}
+
+void print_cache_report(std::ostream &out, const RenderCache::Report &report) {
+	auto tiles = report.tile_hits + report.tile_misses;
+	out << "cache frames: " << report.frame_hits << " hits, " << report.frame_misses << " misses" << std::endl;
+	out << "cache tiles: " << report.tile_hits << " hits, " << report.tile_misses << " misses ("
+		<< (tiles > 0 ? 100 * report.tile_hits / tiles : 0) << "%)" << std::endl;
+	out << "cache traffic: " << report.bytes_read / 1024 << " KiB read, " << report.bytes_written / 1024
+		<< " KiB written, " << report.evictions << " evictions" << std::endl;
+}
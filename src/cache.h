@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// on disk cache of rendered frames and tiles, keyed by render_hash. entries hold linear colors, the pixels are
+// tone mapped again on a hit. once the files exceed max_bytes the least recently used ones are deleted. safe to use
+// from every render thread
+struct RenderCache {
+	struct Report {
+		int frame_hits = 0;
+		int frame_misses = 0;
+		int tile_hits = 0;
+		int tile_misses = 0;
+		int evictions = 0;
+		std::uint64_t bytes_read = 0;
+		std::uint64_t bytes_written = 0;
+	};
+
+	// picks up the entries already in dir, creating it if needed
+	RenderCache(std::string dir, std::uint64_t max_bytes);
+
+	RenderCache(const RenderCache &) = delete;
+	RenderCache &operator=(const RenderCache &) = delete;
+
+	// fills colors with width * height values, top row first, on a hit
+	bool load_frame(std::uint64_t render_hash, int tile_size, int width, int height, std::vector<glm::vec3> &colors);
+	void store_frame(std::uint64_t render_hash, int tile_size, int width, int height, const glm::vec3 *colors);
+
+	// tiles are stored rows top to bottom, rect as in image_tiles
+	bool load_tile(std::uint64_t render_hash, const glm::ivec4 &rect, std::vector<glm::vec3> &colors);
+	void store_tile(std::uint64_t render_hash, const glm::ivec4 &rect, const std::vector<glm::vec3> &colors);
+
+	Report report();
+
+private:
+	bool load(const std::string &name, int width, int height, std::vector<glm::vec3> &colors);
+	void store(const std::string &name, int width, int height, const glm::vec3 *colors);
+	void touch(const std::string &name);
+	void evict();
+
+	std::string dir;
+	std::uint64_t max_bytes;
+
+	std::mutex mutex;
+	std::list<std::string> recent; // most recently used first
+	std::map<std::string, std::pair<std::uint64_t, std::list<std::string>::iterator>> entries; // size, place in recent
+	std::uint64_t total_bytes = 0;
+	Report counts;
+};
+
+void print_cache_report(std::ostream &out, const RenderCache::Report &report);
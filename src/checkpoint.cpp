@@ -0,0 +1,185 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include <glm/vec3.hpp>
+
+#include "image.h"
+
+static constexpr char kCheckpointMagic[4] = {'R', 'T', 'C', 'P'};
+static constexpr std::uint32_t kCheckpointVersion = 2;
+
+// followed by one byte per tile telling whether it is done, then the colors of every done tile row by row in
+// image_tiles order
+struct CheckpointHeader {
+	char magic[4];
+	std::uint32_t version;
+
+	std::int32_t width;
+	std::int32_t height;
+	std::int32_t samples_base;
+	std::int32_t max_depth;
+	std::int32_t ambient_occlusion_samples;
+	std::int32_t tile_size;
+	std::uint32_t seed;
+
+	std::uint32_t tile_count;
+
+	// task_hash, covers the scene, the lightmaps and everything else in the config
+	std::uint64_t render_hash;
+};
+
+static CheckpointHeader make_header(const Config &cfg, std::size_t tile_count, std::uint64_t render_hash) {
+	auto header = CheckpointHeader{
+			.version = kCheckpointVersion,
+			.width = cfg.width,
+			.height = cfg.height,
+			.samples_base = cfg.samples_base,
+			.max_depth = cfg.max_depth,
+			.ambient_occlusion_samples = cfg.ambient_occlusion_samples,
+			.tile_size = cfg.tile_size,
+			.seed = cfg.seed,
+			.tile_count = static_cast<std::uint32_t>(tile_count),
+			.render_hash = render_hash,
+	};
+	std::copy_n(kCheckpointMagic, 4, header.magic);
+	return header;
+}
+
+static bool same_render(const CheckpointHeader &a, const CheckpointHeader &b) {
+	return a.width == b.width && a.height == b.height && a.samples_base == b.samples_base &&
+		   a.max_depth == b.max_depth && a.ambient_occlusion_samples == b.ambient_occlusion_samples &&
+		   a.tile_size == b.tile_size && a.seed == b.seed && a.tile_count == b.tile_count &&
+		   a.render_hash == b.render_hash;
+}
+
+bool load_checkpoint(const std::string &path, RenderingTask &task, std::string &error) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		error = "cannot open " + path;
+		return false;
+	}
+
+	const auto &cfg = task.cfg;
+	auto tiles = image_tiles(cfg);
+	auto expected = make_header(cfg, tiles.size(), task_hash(task));
+
+	CheckpointHeader header;
+	if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+		!std::equal(kCheckpointMagic, kCheckpointMagic + 4, header.magic) || header.version != kCheckpointVersion) {
+		error = path + " is not a checkpoint";
+		return false;
+	}
+	if (!same_render(header, expected)) {
+		error = path + " was written for a different scene, lightmaps, camera or config";
+		return false;
+	}
+
+	std::vector<char> done(tiles.size());
+	if (!in.read(done.data(), done.size())) {
+		error = path + " is truncated";
+		return false;
+	}
+
+	task.tiles_done.assign(tiles.size(), false);
+	for (auto i = 0; i < tiles.size(); ++i) {
+		if (!done[i]) continue;
+
+		const auto &rect = tiles[i];
+		auto w = rect.z - rect.x;
+		for (auto y = rect.y; y < rect.w; ++y) {
+			auto offset = (cfg.height - y - 1) * cfg.width + rect.x;
+			if (!in.read(reinterpret_cast<char *>(task.color_buffer + offset), w * sizeof(glm::vec3))) {
+				task.tiles_done.clear();
+				error = path + " is truncated";
+				return false;
+			}
+			tone_map(task.color_buffer + offset, w, task.pixel_buffer + offset * 3);
+		}
+		task.tiles_done[i] = true;
+	}
+	return true;
+}
+
+CheckpointWriter::CheckpointWriter(std::string path, const RenderingTask &task, std::chrono::milliseconds interval)
+		: path(std::move(path)), task(task), interval(interval), hash(task_hash(task)),
+		  done(image_tiles(task.cfg).size(), false) {
+	for (auto i = 0; i < task.tiles_done.size() && i < done.size(); ++i) done[i] = task.tiles_done[i];
+	thread = std::thread([this]() { run(); });
+}
+
+CheckpointWriter::~CheckpointWriter() {
+	{
+		const std::lock_guard guard(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+void CheckpointWriter::tile_done(const glm::ivec4 &rect) {
+	// a quick fill after the deadline is not worth resuming from
+	auto index = tile_index(task.cfg, rect);
+	if (index < task.tiles_filled.size() && task.tiles_filled[index]) return;
+
+	const std::lock_guard guard(mutex);
+	done[index] = true;
+	changed = true;
+}
+
+void CheckpointWriter::run() {
+	while (true) {
+		std::vector<bool> snapshot;
+		bool last;
+		{
+			std::unique_lock lock(mutex);
+			wake.wait_for(lock, interval, [this]() { return stopping; });
+			last = stopping;
+			if (!changed && !last) continue;
+
+			// finished tiles are never written again, their colors can be read while the render goes on
+			snapshot = done;
+			changed = false;
+		}
+
+		write(snapshot);
+		if (last) return;
+	}
+}
+
+void CheckpointWriter::write(const std::vector<bool> &done) {
+	const auto &cfg = task.cfg;
+	auto tiles = image_tiles(cfg);
+	auto header = make_header(cfg, tiles.size(), hash);
+
+	// written next to the old checkpoint and renamed over it, a kill halfway through leaves the old one intact
+	auto tmp_path = path + ".tmp";
+	{
+		std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		for (auto tile_done : done) out.put(tile_done ? 1 : 0);
+
+		for (auto i = 0; i < tiles.size(); ++i) {
+			if (!done[i]) continue;
+
+			const auto &rect = tiles[i];
+			for (auto y = rect.y; y < rect.w; ++y) {
+				auto offset = (cfg.height - y - 1) * cfg.width + rect.x;
+				out.write(reinterpret_cast<const char *>(task.color_buffer + offset),
+						  (rect.z - rect.x) * sizeof(glm::vec3));
+			}
+		}
+
+		if (!out.flush()) {
+			std::cerr << "failed to write checkpoint " << tmp_path << std::endl;
+			return;
+		}
+	}
+
+	if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+		std::cerr << "failed to replace checkpoint " << path << std::endl;
+}
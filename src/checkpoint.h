@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/vec4.hpp>
+
+#include "render.h"
+
+// a checkpoint holds the config, a hash of the scene, lightmaps and config, the finished tile map and the linear
+// colors of every finished tile. tiles seed their sampler from cfg.seed and their position, so a resumed render ends
+// up with the same image the interrupted one would have written.
+
+// restores task.tiles_done, task.color_buffer and task.pixel_buffer from the checkpoint at path. fails if the file
+// is missing, broken or was written for a different render
+bool load_checkpoint(const std::string &path, RenderingTask &task, std::string &error);
+
+// writes a checkpoint of task every interval from its own thread, render threads only mark their tiles done and
+// never wait for the file. task.color_buffer has to be set
+struct CheckpointWriter {
+	CheckpointWriter(std::string path, const RenderingTask &task, std::chrono::milliseconds interval);
+	// stops the writer thread and writes a last checkpoint
+	~CheckpointWriter();
+
+	CheckpointWriter(const CheckpointWriter &) = delete;
+	CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+	// called from the render thread, once the tile's colors are in task.color_buffer
+	void tile_done(const glm::ivec4 &rect);
+
+private:
+	void run();
+	void write(const std::vector<bool> &done);
+
+	std::string path;
+	const RenderingTask &task;
+	std::chrono::milliseconds interval;
+	std::uint64_t hash; // task_hash of task
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<bool> done;
+	bool changed = false;
+	bool stopping = false;
+
+	std::thread thread;
+};
@@ -1,5 +1,16 @@
 #pragma once
 
+enum class Integrator {
+	kPath = 0, // ray_color, traced from the camera only
+	kBidirectional, // bidirectional_color, see bidirectional.h
+
+	// previews, see integrator.h
+	kAmbientOcclusion,
+	kDirect, // ray_color without indirect bounces or lightmaps
+	kAlbedo,
+	kNormal,
+};
+
 struct Config {
 	int width = 540;
 	int height = 540;
@@ -8,4 +19,32 @@ struct Config {
 	int max_depth = 5;
 
 	int ambient_occlusion_samples = 5;
+
+	int threads = 0; // 0 uses every hardware thread
+	int tile_size = 100;
+
+	// tiles seed their sampler from it and their position, a frame comes out the same however its tiles are split
+	// over threads, processes or resumed renders
+	unsigned int seed = 0;
+
+	// ward's a for the irradiance cache of the first indirect bounce, 0 traces every bounce instead. smaller values
+	// trust a record over a shorter distance, .2 to .4 is a good start
+	float irradiance_error = 0;
+
+	// cell size of the ambient occlusion cache in scene units, 0 traces every shading point. a cell is reused once it
+	// holds ao_cache_confidence rays
+	float ao_cache_cell = 0;
+	int ao_cache_confidence = 64;
+
+	// samples per pixel that are rendered as whole frame passes before the tiles, each training path guiding for the
+	// samples after it. at most samples_base^2 - 1 are, 0 samples indirect bounces from the hemisphere only
+	int guiding_passes = 0;
+
+	// camera hits share their light samples with the pixels nearby and the sample passes after them and trace one
+	// shadow ray each, see reservoir.h. otherwise every hit traces every light. only the path and direct light
+	// integrators resample
+	bool resample_lights = false;
+
+	// only generate_image picks the integrator, servers and distributed workers trace tiles with ray_color
+	Integrator integrator = Integrator::kPath;
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ao_cache.h"
+#include "bidirectional.h"
+#include "guiding.h"
+#include "irradiance_cache.h"
+#include "lightmap.h"
+#include "reservoir.h"
+
+// what the kernels use besides scene, camera and config, everything optional. the caches, lightmaps, guide and light
+// image are shared by the render threads of a frame, every thread copies the context and sets its own bitset and
+// reservoir in the copy. counters go to Stats instead
+struct RenderContext {
+	// bitset indexed by EntityId, hit_scene sets the bit of everything a ray hits
+	std::uint64_t *touched_entities = nullptr;
+
+	IrradianceCache *irradiance_cache = nullptr;
+	AmbientOcclusionCache *ao_cache = nullptr;
+	const Lightmaps *lightmaps = nullptr;
+	// indirect bounces sample from it when set, and record the light they find into it if record_guiding is set
+	GuidingTree *guiding = nullptr;
+	bool record_guiding = false;
+	// bidirectional paths splat what the camera sees of their light vertices into it
+	LightImage *light_image = nullptr;
+	// set per camera sample when lights are resampled, the sample it kept lights the camera hit
+	const Reservoir *light_reservoir = nullptr;
+};
@@ -0,0 +1,11 @@
+#include "cpu.h"
+
+const char *kernel_isa() {
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+	// same order the target_clones resolver checks the cpuid feature bits in
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("x86-64-v4")) return "x86-64-v4 (avx512)";
+	if (__builtin_cpu_supports("x86-64-v3")) return "x86-64-v3 (avx2, fma)";
+#endif
+	return "default";
+}
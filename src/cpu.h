@@ -0,0 +1,11 @@
+#pragma once
+
+// compiles a kernel for several x86-64 ISA levels, the loader binds the best one the host cpu supports
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define ISA_KERNEL __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define ISA_KERNEL
+#endif
+
+// name of the ISA level ISA_KERNEL functions run with on this host
+const char *kernel_isa();
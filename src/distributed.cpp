@@ -0,0 +1,361 @@
+#include "distributed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "render.h"
+#include "scenes.h"
+#include "stream_io.h"
+
+using Clock = std::chrono::steady_clock;
+
+// tiles queued on a worker at once, so it never waits for the coordinator between two tiles
+static constexpr int kTilesInFlight = 2;
+
+static std::string job_line(const std::string &scene, const Config &cfg) {
+	return "job scene=" + scene + " width=" + std::to_string(cfg.width) + " height=" + std::to_string(cfg.height) +
+		   " samples=" + std::to_string(cfg.samples_base) + " depth=" + std::to_string(cfg.max_depth) +
+		   " ao=" + std::to_string(cfg.ambient_occlusion_samples) + "\n";
+}
+
+static bool parse_job(std::istringstream &args, std::string &scene, Config &cfg) {
+	std::string arg;
+	while (args >> arg) {
+		auto split = arg.find('=');
+		if (split == std::string::npos) return false;
+		auto key = arg.substr(0, split);
+		auto value = arg.substr(split + 1);
+
+		if (key == "scene") scene = value;
+		else if (key == "width") cfg.width = std::stoi(value);
+		else if (key == "height") cfg.height = std::stoi(value);
+		else if (key == "samples") cfg.samples_base = std::stoi(value);
+		else if (key == "depth") cfg.max_depth = std::stoi(value);
+		else if (key == "ao") cfg.ambient_occlusion_samples = std::stoi(value);
+		else return false;
+	}
+	return cfg.width > 0 && cfg.height > 0 && cfg.samples_base > 0;
+}
+
+int run_render_worker(int in_fd, int out_fd) {
+	LineReader reader{.fd = in_fd};
+	std::string line;
+
+	Config cfg;
+	Camera cam{};
+	Scene scene;
+	std::vector<char> pixels;
+	std::unique_ptr<RenderingTask> task;
+
+	while (reader.read_line(line)) {
+		std::istringstream args(line);
+		std::string command;
+		args >> command;
+
+		if (command == "job") {
+			std::string scene_id;
+			const SceneEntry *entry = nullptr;
+			try {
+				if (parse_job(args, scene_id, cfg)) entry = find_scene(scene_id);
+			} catch (const std::exception &) {
+			}
+			if (!entry) {
+				write_line(out_fd, "error invalid job: " + line + "\n");
+				return 1;
+			}
+
+			scene = Scene{};
+			entry->make_scene(scene);
+			cam = entry->make_camera();
+			init_camera(cam, cfg.width, cfg.height);
+			pixels.assign(cfg.width * cfg.height * 3, 0);
+
+			task.reset(new RenderingTask{.cfg = cfg, .cam = cam, .scene = scene, .pixel_buffer = pixels.data()});
+			task->ray_color = select_ray_color(scene, cfg);
+
+			if (!write_line(out_fd, "ready\n")) return 1;
+		} else if (command == "tile" && task) {
+			int index;
+			glm::ivec4 rect;
+			if (!(args >> index >> rect.x >> rect.y >> rect.z >> rect.w)) return 1;
+
+			Stats stats;
+			render_tile(*task, rect, task->context, stats);
+
+			auto y = cfg.height - rect.w;
+			auto w = rect.z - rect.x;
+			if (!write_line(out_fd, "tile " + std::to_string(index) + " " + std::to_string(stats.ray_count) + "\n"))
+				return 1;
+			for (auto row = y; row < cfg.height - rect.y; ++row)
+				if (!write_all(out_fd, pixels.data() + (row * cfg.width + rect.x) * 3, w * 3)) return 1;
+		} else if (command == "quit") {
+			return 0;
+		} else {
+			write_line(out_fd, "error unexpected " + line + "\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+struct WorkerEvent {
+	enum Type {
+		kReady,
+		kTile,
+		kDied,
+	};
+
+	Type type;
+	int worker;
+	int tile = -1;
+	std::uint64_t rays = 0;
+	std::vector<char> pixels;
+};
+
+struct WorkerProcess {
+	pid_t pid = -1;
+	int fd = -1;
+	bool ready = false;
+	bool alive = true;
+	int tiles_done = 0;
+	std::vector<int> in_flight;
+	std::thread reader;
+};
+
+struct EventQueue {
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<WorkerEvent> events;
+
+	void push(WorkerEvent event) {
+		{
+			const std::lock_guard guard(mutex);
+			events.push_back(std::move(event));
+		}
+		changed.notify_one();
+	}
+
+	std::optional<WorkerEvent> pop(std::chrono::milliseconds timeout) {
+		std::unique_lock lock(mutex);
+		if (!changed.wait_for(lock, timeout, [this]() { return !events.empty(); })) return {};
+		auto event = std::move(events.front());
+		events.pop_front();
+		return event;
+	}
+};
+
+static bool spawn_worker(const CoordinatorOptions &options, WorkerProcess &worker) {
+	// close on exec, or every worker spawned later would inherit this coordinator end and hold it open after this
+	// worker died. dup2 clears the flag on the child's stdin and stdout
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) return false;
+
+	auto pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		dup2(fds[1], STDIN_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[1]);
+
+		if (options.worker_command.empty())
+			execl("/proc/self/exe", "raytracer", "--worker", nullptr);
+		else
+			execl("/bin/sh", "sh", "-c", options.worker_command.c_str(), nullptr);
+		_exit(127);
+	}
+
+	close(fds[1]);
+	worker.pid = pid;
+	worker.fd = fds[0];
+	return true;
+}
+
+static void read_worker(int index, int fd, const std::vector<glm::ivec4> &tiles, EventQueue &queue) {
+	LineReader reader{.fd = fd};
+	std::string line;
+
+	while (reader.read_line(line)) {
+		std::istringstream args(line);
+		std::string command;
+		args >> command;
+
+		if (command == "ready") {
+			queue.push(WorkerEvent{.type = WorkerEvent::kReady, .worker = index});
+			continue;
+		}
+
+		WorkerEvent event{.type = WorkerEvent::kTile, .worker = index};
+		if (command != "tile" || !(args >> event.tile >> event.rays) || event.tile < 0 || event.tile >= tiles.size())
+			break;
+
+		const auto &rect = tiles[event.tile];
+		event.pixels.resize((rect.z - rect.x) * (rect.w - rect.y) * 3);
+		if (!reader.read_bytes(event.pixels.data(), event.pixels.size())) break;
+		queue.push(std::move(event));
+	}
+
+	queue.push(WorkerEvent{.type = WorkerEvent::kDied, .worker = index});
+}
+
+DistributedResult run_coordinator(const CoordinatorOptions &options, const Config &cfg) {
+	DistributedResult result;
+	result.pixels.assign(cfg.width * cfg.height * 3, 0);
+
+	auto tiles = image_tiles(cfg);
+	std::vector<bool> done(tiles.size(), false);
+	std::vector<Clock::time_point> handed_out(tiles.size());
+	std::vector<int> copies(tiles.size(), 0);
+	std::deque<int> pending;
+	for (auto i = 0; i < tiles.size(); ++i) pending.push_back(i);
+	auto remaining = tiles.size();
+
+	EventQueue queue;
+	auto worker_count = options.workers > 0 ? options.workers : render_thread_count(Config{});
+	std::vector<std::unique_ptr<WorkerProcess>> workers;
+
+	auto job = job_line(options.scene, cfg);
+	for (auto i = 0; i < worker_count; ++i) {
+		auto worker = std::make_unique<WorkerProcess>();
+		if (!spawn_worker(options, *worker)) {
+			std::cerr << "failed to start worker " << i << std::endl;
+			continue;
+		}
+		std::cout << "worker " << workers.size() << ": pid " << worker->pid << std::endl;
+
+		worker->alive = write_line(worker->fd, job);
+		worker->reader = std::thread(read_worker, static_cast<int>(workers.size()), worker->fd, std::cref(tiles),
+									 std::ref(queue));
+		workers.push_back(std::move(worker));
+	}
+
+	auto send_tile = [&](WorkerProcess &worker, int tile) {
+		const auto &rect = tiles[tile];
+		auto line = "tile " + std::to_string(tile) + " " + std::to_string(rect.x) + " " + std::to_string(rect.y) +
+					" " + std::to_string(rect.z) + " " + std::to_string(rect.w) + "\n";
+		if (!write_line(worker.fd, line)) return false;
+
+		worker.in_flight.push_back(tile);
+		handed_out[tile] = Clock::now();
+		++copies[tile];
+		return true;
+	};
+
+	auto requeue = [&](WorkerProcess &worker) {
+		for (auto tile : worker.in_flight) {
+			if (done[tile] || --copies[tile] > 0) continue;
+			pending.push_front(tile);
+			++result.reassigned_tiles;
+		}
+		worker.in_flight.clear();
+	};
+
+	while (remaining > 0) {
+		auto any_alive = false;
+
+		for (auto &worker : workers) {
+			if (!worker->alive) continue;
+			any_alive = true;
+			if (!worker->ready) continue;
+
+			while (!pending.empty() && worker->in_flight.size() < kTilesInFlight) {
+				auto tile = pending.front();
+				pending.pop_front();
+				if (done[tile]) continue;
+				if (!send_tile(*worker, tile)) {
+					pending.push_front(tile);
+					break;
+				}
+			}
+
+			// nothing left to hand out, help with the oldest tile another worker is taking too long for
+			if (pending.empty() && worker->in_flight.empty()) {
+				auto now = Clock::now();
+				std::optional<int> overdue;
+				for (auto i = 0; i < tiles.size(); ++i) {
+					if (done[i] || copies[i] != 1) continue;
+					auto age = std::chrono::duration<double, std::milli>(now - handed_out[i]).count();
+					if (age > options.tile_timeout_ms && (!overdue || handed_out[i] < handed_out[*overdue]))
+						overdue = i;
+				}
+				if (overdue && send_tile(*worker, *overdue)) ++result.reassigned_tiles;
+			}
+		}
+
+		if (!any_alive) {
+			std::cerr << "all workers died, " << remaining << " tiles missing" << std::endl;
+			break;
+		}
+
+		auto event = queue.pop(std::chrono::milliseconds(100));
+		if (!event) continue;
+
+		auto &worker = *workers[event->worker];
+		switch (event->type) {
+		case WorkerEvent::kReady:
+			worker.ready = true;
+			break;
+
+		case WorkerEvent::kDied:
+			if (worker.alive) std::cerr << "worker " << event->worker << " died" << std::endl;
+			worker.alive = false;
+			requeue(worker);
+			break;
+
+		case WorkerEvent::kTile: {
+			std::erase(worker.in_flight, event->tile);
+			--copies[event->tile];
+			if (done[event->tile]) break;
+
+			const auto &rect = tiles[event->tile];
+			auto w = rect.z - rect.x;
+			auto y = cfg.height - rect.w;
+			for (auto row = 0; row < rect.w - rect.y; ++row) {
+				std::copy_n(event->pixels.begin() + row * w * 3, w * 3,
+							result.pixels.begin() + ((y + row) * cfg.width + rect.x) * 3);
+			}
+
+			done[event->tile] = true;
+			result.rays += event->rays;
+			++worker.tiles_done;
+			--remaining;
+			break;
+		}
+		}
+	}
+
+	// a worker still busy at this point is hung on a tile somebody else already delivered, it would never read quit
+	for (auto &worker : workers) {
+		if (!worker->in_flight.empty()) kill(worker->pid, SIGKILL);
+		else if (worker->alive) write_line(worker->fd, "quit\n");
+		shutdown(worker->fd, SHUT_WR);
+	}
+	for (auto i = 0; i < workers.size(); ++i) {
+		auto &worker = *workers[i];
+		if (worker.reader.joinable()) worker.reader.join();
+		close(worker.fd);
+		waitpid(worker.pid, nullptr, 0);
+		std::cout << "worker " << i << ": " << worker.tiles_done << " tiles" << std::endl;
+	}
+
+	result.complete = remaining == 0;
+	return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+// a coordinator splits one frame into image_tiles and hands them to worker processes over a socket pair each.
+// workers load the scene once and answer every tile with its pixels. tiles of workers that die are handed out
+// again, and once nothing is left to hand out, tiles that are overdue are duplicated to idle workers.
+//
+// coordinator -> worker:
+//   job scene=<id> width=n height=n samples=n depth=n ao=n
+//   tile <index> <x0> <y0> <x1> <y1>
+//   quit
+// worker -> coordinator:
+//   ready | error <message>
+//   tile <index> <rays>, followed by the tile's rgb bytes in image space (rows top to bottom)
+
+struct CoordinatorOptions {
+	std::string scene = "cornell_box";
+	int workers = 0; // 0 starts one worker per hardware thread
+	// started through /bin/sh -c for every worker, e.g. to reach other hosts over ssh. runs this binary with
+	// --worker when empty
+	std::string worker_command;
+	double tile_timeout_ms = 10000; // a tile in flight for longer is given to another worker as well
+};
+
+struct DistributedResult {
+	std::vector<char> pixels; // 8 bit rgb, top row first
+	std::uint64_t rays = 0;
+	int reassigned_tiles = 0;
+	bool complete = false;
+};
+
+DistributedResult run_coordinator(const CoordinatorOptions &options, const Config &cfg);
+
+// serves tiles over in_fd / out_fd until the coordinator quits or closes the stream
+int run_render_worker(int in_fd, int out_fd);
@@ -0,0 +1,228 @@
+#include "guiding.h"
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include <glm/glm.hpp>
+
+#include "math.h"
+
+// share of the recorded energy above which a quadrant is split, and the depth quadtrees stop at
+static constexpr float kGuidingSplit = .01f;
+static constexpr int kMaxDirectionDepth = 20;
+
+// recorded samples above which a leaf of the spatial tree is halved
+static constexpr std::uint32_t kSpatialSplit = 4000;
+
+static constexpr std::uint32_t kNoSource = std::numeric_limits<std::uint32_t>::max();
+
+// largest float below one, keeps rescaled sample numbers inside their quadrant
+static constexpr float kOneMinusEpsilon = 0x1.fffffep-1f;
+
+static glm::vec2 to_square(const glm::vec3 &direction) {
+	auto cos_theta = glm::clamp(direction.z, -1.f, 1.f);
+	auto phi = std::atan2(direction.y, direction.x);
+	if (phi < 0.f) phi += 2.f * PI;
+	auto u = (cos_theta + 1.f) * .5f;
+	auto v = phi / (2.f * PI);
+	return {glm::clamp(u, 0.f, kOneMinusEpsilon), glm::clamp(v, 0.f, kOneMinusEpsilon)};
+}
+
+static glm::vec3 from_square(const glm::vec2 &point) {
+	auto cos_theta = 2.f * point.x - 1.f;
+	auto sin_theta = glm::sqrt(glm::max(0.f, 1.f - cos_theta * cos_theta));
+	auto phi = 2.f * PI * point.y;
+	return {sin_theta * glm::cos(phi), sin_theta * glm::sin(phi), cos_theta};
+}
+
+// picks the half of a quadrant pair with sums low and high and rescales u to stay uniform inside it
+static int pick_half(float low, float high, float &u) {
+	auto fraction = low / (low + high);
+	if (u < fraction) {
+		u = glm::min(u / fraction, kOneMinusEpsilon);
+		return 0;
+	}
+	u = glm::min((u - fraction) / (1.f - fraction), kOneMinusEpsilon);
+	return 1;
+}
+
+glm::vec3 DirectionTree::sample(float u1, float u2, float &pdf) const {
+	glm::vec2 point(0.f);
+	auto size = 1.f;
+	auto density = 1.f;
+
+	for (std::uint32_t index = 0;;) {
+		const auto &node = nodes[index];
+		auto total = node.sum[0] + node.sum[1] + node.sum[2] + node.sum[3];
+		// nothing recorded below here, the rest of the square is sampled uniformly
+		if (total <= 0.f) break;
+
+		auto x = pick_half(node.sum[0] + node.sum[2], node.sum[1] + node.sum[3], u1);
+		auto y = pick_half(node.sum[x], node.sum[x + 2], u2);
+		auto quadrant = x | y << 1;
+
+		density *= 4.f * node.sum[quadrant] / total;
+		size *= .5f;
+		point.x += x * size;
+		point.y += y * size;
+		if (!node.child[quadrant]) break;
+		index = node.child[quadrant];
+	}
+
+	pdf = density / (4.f * PI);
+	return from_square({point.x + u1 * size, point.y + u2 * size});
+}
+
+float DirectionTree::pdf(const glm::vec3 &direction) const {
+	auto point = to_square(direction);
+	auto density = 1.f;
+
+	for (std::uint32_t index = 0;;) {
+		const auto &node = nodes[index];
+		auto total = node.sum[0] + node.sum[1] + node.sum[2] + node.sum[3];
+		if (total <= 0.f) break;
+
+		auto x = point.x >= .5f ? 1 : 0;
+		auto y = point.y >= .5f ? 1 : 0;
+		auto quadrant = x | y << 1;
+		density *= 4.f * node.sum[quadrant] / total;
+		if (!node.child[quadrant]) break;
+		point = point * 2.f - glm::vec2(x, y);
+		index = node.child[quadrant];
+	}
+	return density / (4.f * PI);
+}
+
+bool DirectionTree::empty() const {
+	const auto &root = nodes[0];
+	return root.sum[0] + root.sum[1] + root.sum[2] + root.sum[3] <= 0.f;
+}
+
+void DirectionTree::record(const glm::vec3 &direction, float value) {
+	auto point = to_square(direction);
+	for (std::uint32_t index = 0;;) {
+		auto &node = nodes[index];
+		auto x = point.x >= .5f ? 1 : 0;
+		auto y = point.y >= .5f ? 1 : 0;
+		auto quadrant = x | y << 1;
+		std::atomic_ref(node.sum[quadrant]).fetch_add(value, std::memory_order_relaxed);
+		if (!node.child[quadrant]) break;
+		point = point * 2.f - glm::vec2(x, y);
+		index = node.child[quadrant];
+	}
+}
+
+void DirectionTree::rebuild(const DirectionTree &tree) {
+	const auto &root = tree.nodes[0];
+	auto total = root.sum[0] + root.sum[1] + root.sum[2] + root.sum[3];
+	// nothing was recorded, the structure is kept for another try
+	if (total <= 0.f) {
+		nodes = tree.nodes;
+		for (auto &node : nodes) node.sum = {};
+		return;
+	}
+
+	nodes.clear();
+	rebuild_node(tree, 0, total, total, 0);
+}
+
+std::uint32_t DirectionTree::rebuild_node(const DirectionTree &tree, std::uint32_t source, float energy, float total,
+										  int depth) {
+	auto index = static_cast<std::uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	for (auto quadrant = 0; quadrant < 4; ++quadrant) {
+		// squares tree does not split spread their energy evenly over the quadrants
+		auto quadrant_energy = source != kNoSource ? tree.nodes[source].sum[quadrant] : energy * .25f;
+		auto quadrant_source = source != kNoSource && tree.nodes[source].child[quadrant]
+							   ? tree.nodes[source].child[quadrant] : kNoSource;
+		if (depth + 1 < kMaxDirectionDepth && quadrant_energy > total * kGuidingSplit) {
+			auto child = rebuild_node(tree, quadrant_source, quadrant_energy, total, depth + 1);
+			nodes[index].child[quadrant] = child;
+		}
+	}
+	return index;
+}
+
+GuidingTree::GuidingTree(const glm::vec3 &min, const glm::vec3 &max) {
+	// a little margin keeps hits on the outer walls of the bounds inside
+	auto margin = glm::max(max - min, glm::vec3(1.f)) * .01f;
+	for (auto root = 0; root < kNormalRoots; ++root) {
+		nodes.push_back(Node{.min = min - margin, .max = max + margin, .cell = root});
+		cells.push_back(std::make_unique<Cell>());
+	}
+}
+
+int GuidingTree::find_cell(const glm::vec3 &position, const glm::vec3 &normal) const {
+	// the root of the axis the normal points along the most, by sign
+	auto n = glm::abs(normal);
+	auto axis = n.x >= n.y && n.x >= n.z ? 0 : n.y >= n.z ? 1 : 2;
+	std::uint32_t index = axis * 2 + (normal[axis] < 0.f ? 1 : 0);
+	while (nodes[index].cell < 0) {
+		const auto &node = nodes[index];
+		index = node.child[position[node.axis] >= node.split ? 1 : 0];
+	}
+	return nodes[index].cell;
+}
+
+const DirectionTree &GuidingTree::distribution(const glm::vec3 &position, const glm::vec3 &normal) const {
+	return cells[find_cell(position, normal)]->sampling;
+}
+
+void GuidingTree::record(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec3 &direction,
+						 float value) {
+	auto &cell = *cells[find_cell(position, normal)];
+	cell.building.record(direction, value);
+	cell.samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+void GuidingTree::refine() {
+	for (auto &cell : cells) {
+		cell->sampling = cell->building;
+		cell->building.rebuild(cell->sampling);
+	}
+
+	auto leaves = static_cast<std::uint32_t>(nodes.size());
+	for (std::uint32_t i = 0; i < leaves; ++i)
+		if (nodes[i].cell >= 0) split(i);
+
+	for (auto &cell : cells) cell->samples = 0;
+}
+
+// halves the leaf along its longest axis while it got more than kSpatialSplit samples, the halves start from the
+// distributions of the leaf and are assumed to have got half its samples each
+void GuidingTree::split(std::uint32_t index) {
+	auto &cell = *cells[nodes[index].cell];
+	auto samples = cell.samples.load();
+	if (samples <= kSpatialSplit) return;
+
+	auto extent = nodes[index].max - nodes[index].min;
+	auto axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+	auto middle = (nodes[index].min[axis] + nodes[index].max[axis]) * .5f;
+
+	auto above = std::make_unique<Cell>();
+	above->sampling = cell.sampling;
+	above->building = cell.building;
+	above->samples = samples / 2;
+	cell.samples = samples / 2;
+
+	auto below_node = Node{.min = nodes[index].min, .max = nodes[index].max, .cell = nodes[index].cell};
+	below_node.max[axis] = middle;
+	auto above_node = Node{.min = nodes[index].min, .max = nodes[index].max, .cell = static_cast<int>(cells.size())};
+	above_node.min[axis] = middle;
+	cells.push_back(std::move(above));
+
+	auto below_index = static_cast<std::uint32_t>(nodes.size());
+	nodes.push_back(below_node);
+	nodes.push_back(above_node);
+
+	auto &node = nodes[index];
+	node.axis = axis;
+	node.split = middle;
+	node.child = {below_index, below_index + 1};
+	node.cell = -1;
+
+	split(below_index);
+	split(below_index + 1);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+// path guiding after müller et al., practical path guiding. a binary tree over space holds in every leaf a quadtree
+// over the directions of the sphere, mapped to the unit square by the equal area cylindrical mapping. training passes
+// record the light that arrives at path vertices into the quadtrees, refine turns what was recorded into the
+// distribution indirect bounces are sampled from next and splits leaves and quadrants that got much of it
+
+// share of indirect bounces that sample the guide instead of the hemisphere
+static constexpr float kGuidingFraction = .5f;
+
+class DirectionTree {
+public:
+	// direction for the uniform numbers u1, u2 and its density over the sphere
+	glm::vec3 sample(float u1, float u2, float &pdf) const;
+	float pdf(const glm::vec3 &direction) const;
+
+	// nothing was recorded for it, sample is uniform over the sphere
+	bool empty() const;
+
+	// adds value, an estimate of the light from direction over its pdf. safe to call from several threads, but not
+	// together with anything else
+	void record(const glm::vec3 &direction, float value);
+
+	// structure for the next pass from the energy recorded in tree, quadrants holding more than a kGuidingSplit share
+	// of it are split and the others merged. sums start from zero
+	void rebuild(const DirectionTree &tree);
+
+	std::size_t size() const { return nodes.size(); }
+
+private:
+	struct Node {
+		std::array<float, 4> sum{}; // per quadrant, x in bit 0 and y in bit 1
+		std::array<std::uint32_t, 4> child{}; // 0 for quadrants that are not split, the root is never a child
+	};
+
+	// appends the node for the square of source in tree, or of a square tree does not split with energy
+	std::uint32_t rebuild_node(const DirectionTree &tree, std::uint32_t source, float energy, float total, int depth);
+
+	std::vector<Node> nodes{1};
+};
+
+// surfaces facing different ways see different halves of the sphere, so every axis and sign of the normal gets a
+// spatial tree of its own
+class GuidingTree {
+public:
+	// splits space over min to max, positions outside go to the closest leaf
+	GuidingTree(const glm::vec3 &min, const glm::vec3 &max);
+
+	// sampling distribution at position on a surface with normal, fixed until the next refine
+	const DirectionTree &distribution(const glm::vec3 &position, const glm::vec3 &normal) const;
+
+	// records light arriving at position from direction for the next refine, value as for DirectionTree::record.
+	// safe to call from several threads, but not together with refine
+	void record(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec3 &direction, float value);
+
+	// ends a training pass, what was recorded is sampled from now on
+	void refine();
+
+	std::size_t leaves() const { return cells.size(); }
+
+private:
+	struct Cell {
+		DirectionTree sampling;
+		DirectionTree building;
+		std::atomic<std::uint32_t> samples = 0;
+	};
+
+	struct Node {
+		glm::vec3 min;
+		glm::vec3 max;
+		int axis = 0;
+		float split = 0;
+		std::array<std::uint32_t, 2> child{}; // below and above split, for inner nodes
+		int cell = -1; // into cells, for leaves
+	};
+
+	static constexpr int kNormalRoots = 6;
+
+	int find_cell(const glm::vec3 &position, const glm::vec3 &normal) const;
+	void split(std::uint32_t node);
+
+	std::vector<Node> nodes; // starts with the kNormalRoots roots
+	std::vector<std::unique_ptr<Cell>> cells;
+};
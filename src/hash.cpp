@@ -0,0 +1,124 @@
+#include "hash.h"
+
+#include <cstring>
+
+static constexpr std::uint64_t kFnvPrime = 1099511628211ull;
+
+void ContentHash::add(const void *data, std::size_t size) {
+	auto bytes = static_cast<const unsigned char *>(data);
+	for (std::size_t i = 0; i < size; ++i) {
+		value ^= bytes[i];
+		value *= kFnvPrime;
+	}
+}
+
+void ContentHash::add(std::int64_t v) {
+	add(&v, sizeof(v));
+}
+
+void ContentHash::add(float v) {
+	// -0 and 0 render the same
+	if (v == 0.f) v = 0.f;
+	std::uint32_t bits;
+	std::memcpy(&bits, &v, sizeof(bits));
+	add(&bits, sizeof(bits));
+}
+
+void ContentHash::add(const glm::vec3 &v) {
+	add(v.x);
+	add(v.y);
+	add(v.z);
+}
+
+void ContentHash::add(const glm::ivec4 &v) {
+	add(static_cast<std::int64_t>(v.x));
+	add(static_cast<std::int64_t>(v.y));
+	add(static_cast<std::int64_t>(v.z));
+	add(static_cast<std::int64_t>(v.w));
+}
+
+// field by field, padding and the unused bytes of the material union would make a byte hash unstable
+void hash_material(ContentHash &hash, const Material &material) {
+	hash.add(static_cast<std::int64_t>(material.type));
+	hash.add(material.color);
+	if (material.type == MaterialType::kBlinnPhong) {
+		hash.add(material.blinnPhong.diffuse_intensity);
+		hash.add(material.blinnPhong.specular_intensity);
+		hash.add(material.blinnPhong.shininess);
+	}
+}
+
+void hash_plane(ContentHash &hash, const Plane &plane) {
+	hash.add(static_cast<std::int64_t>(plane.id));
+	hash.add(plane.position);
+	hash.add(plane.normal);
+	hash.add(plane.tangent);
+	hash.add(plane.bi_tangent);
+	hash.add(plane.width);
+	hash.add(plane.height);
+}
+
+void hash_scene(ContentHash &hash, const Scene &scene) {
+	hash.add(static_cast<std::int64_t>(scene.spheres.size()));
+	for (auto i = 0; i < scene.spheres.size(); ++i) {
+		const auto &sphere = scene.spheres[i];
+		hash.add(static_cast<std::int64_t>(sphere.id));
+		hash.add(sphere.position);
+		hash.add(sphere.radius);
+		hash_material(hash, scene.sphere_materials[i]);
+	}
+
+	hash.add(static_cast<std::int64_t>(scene.planes.size()));
+	for (auto i = 0; i < scene.planes.size(); ++i) {
+		hash_plane(hash, scene.planes[i]);
+		hash_material(hash, scene.plane_materials[i]);
+	}
+
+	hash.add(static_cast<std::int64_t>(scene.directional_lights.size()));
+	for (const auto &light : scene.directional_lights) {
+		hash.add(light.direction);
+		hash.add(light.color);
+		hash.add(light.intensity);
+	}
+
+	hash.add(static_cast<std::int64_t>(scene.area_lights.size()));
+	for (auto i = 0; i < scene.area_lights.size(); ++i) {
+		const auto &light = scene.area_light_data[i];
+		hash_plane(hash, scene.area_lights[i]);
+		hash.add(light.color);
+		hash.add(light.intensity);
+		hash.add(static_cast<std::int64_t>(light.u_samples));
+		hash.add(static_cast<std::int64_t>(light.v_samples));
+		hash.add(light.max_random_offset);
+	}
+}
+
+void hash_camera(ContentHash &hash, const Camera &cam) {
+	hash.add(cam.position);
+	hash.add(cam.look_at);
+	hash.add(cam.vfov);
+	hash.add(cam.focal_length);
+	hash.add(cam.lower_left_corner);
+	hash.add(cam.span_horizontal);
+	hash.add(cam.span_vertical);
+}
+
+std::uint64_t render_hash(const Scene &scene, const Camera &cam, const Config &cfg) {
+	ContentHash hash;
+	hash_scene(hash, scene);
+	hash_camera(hash, cam);
+
+	hash.add(static_cast<std::int64_t>(cfg.width));
+	hash.add(static_cast<std::int64_t>(cfg.height));
+	hash.add(static_cast<std::int64_t>(cfg.samples_base));
+	hash.add(static_cast<std::int64_t>(cfg.max_depth));
+	hash.add(static_cast<std::int64_t>(cfg.ambient_occlusion_samples));
+	hash.add(static_cast<std::int64_t>(cfg.seed));
+	hash.add(cfg.irradiance_error);
+	hash.add(cfg.ao_cache_cell);
+	hash.add(static_cast<std::int64_t>(cfg.ao_cache_confidence));
+	hash.add(static_cast<std::int64_t>(cfg.guiding_passes));
+	hash.add(static_cast<std::int64_t>(cfg.integrator));
+	hash.add(static_cast<std::int64_t>(cfg.resample_lights));
+	return hash.value;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "camera.h"
+#include "config.h"
+#include "scene.h"
+
+// 64 bit fnv-1a, stable across runs and builds so it can key files on disk
+struct ContentHash {
+	std::uint64_t value = 14695981039346656037ull;
+
+	void add(const void *data, std::size_t size);
+	void add(std::int64_t v);
+	void add(float v);
+	void add(const glm::vec3 &v);
+	void add(const glm::ivec4 &v);
+};
+
+void hash_material(ContentHash &hash, const Material &material);
+void hash_plane(ContentHash &hash, const Plane &plane);
+void hash_scene(ContentHash &hash, const Scene &scene);
+void hash_camera(ContentHash &hash, const Camera &cam);
+
+// everything that decides what a pixel comes out as: scene, camera and the config down to the seed. tile_size and
+// threads are left out, tile_size only matters for a whole frame since it moves the tile seeds
+std::uint64_t render_hash(const Scene &scene, const Camera &cam, const Config &cfg);
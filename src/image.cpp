@@ -0,0 +1,35 @@
+#include "image.h"
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "cpu.h"
+
+ISA_KERNEL
+void tone_map(const glm::vec3 *colors, int count, char *out) {
+	for (auto i = 0; i < count; ++i) {
+		auto color = glm::clamp(colors[i], 0.f, 1.f);
+		// through unsigned char, a float above 127 does not fit a char and converting it is undefined
+		out[i * 3 + 0] = static_cast<char>(static_cast<unsigned char>(255.99f * color.r));
+		out[i * 3 + 1] = static_cast<char>(static_cast<unsigned char>(255.99f * color.g));
+		out[i * 3 + 2] = static_cast<char>(static_cast<unsigned char>(255.99f * color.b));
+	}
+}
+
+void heatmap(const float *values, int count, char *out) {
+	static const glm::vec3 ramp[] = {{0, 0, 1}, {0, 1, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0}};
+	static constexpr int kSteps = sizeof(ramp) / sizeof(ramp[0]) - 1;
+
+	auto max_value = 0.f;
+	for (auto i = 0; i < count; ++i) max_value = glm::max(max_value, values[i]);
+
+	std::vector<glm::vec3> colors(count);
+	for (auto i = 0; i < count; ++i) {
+		auto t = max_value > 0.f ? values[i] / max_value * kSteps : 0.f;
+		auto step = glm::min(static_cast<int>(t), kSteps - 1);
+		auto f = t - static_cast<float>(step);
+		colors[i] = ramp[step] * (1.f - f) + ramp[step + 1] * f;
+	}
+	tone_map(colors.data(), count, out);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+// clamps linear colors to [0, 1] and writes them as 8 bit rgb triples
+void tone_map(const glm::vec3 *colors, int count, char *out);
+
+// maps values to a blue - cyan - green - yellow - red ramp scaled to the largest value, as 8 bit rgb triples
+void heatmap(const float *values, int count, char *out);
@@ -0,0 +1,236 @@
+#include "incremental.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+
+#include <glm/glm.hpp>
+
+#include "hash.h"
+#include "render.h"
+#include "serialize.h"
+
+static constexpr char kRecordMagic[4] = {'R', 'T', 'F', 'R'};
+
+// above this share of the frame an incremental render saves too little to be worth the guesswork
+static constexpr float kFullRenderFraction = .75f;
+
+bool save_frame_record(const std::string &path, const FrameRecord &record) {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(kRecordMagic, sizeof(kRecordMagic));
+	out.write(reinterpret_cast<const char *>(&record.cam), sizeof(record.cam));
+	out.write(reinterpret_cast<const char *>(&record.cfg), sizeof(record.cfg));
+	out.write(reinterpret_cast<const char *>(&record.lightmaps), sizeof(record.lightmaps));
+
+	const auto &scene = record.scene;
+	out.write(reinterpret_cast<const char *>(&scene.next_entity_id), sizeof(scene.next_entity_id));
+	write_vector(out, scene.spheres);
+	write_vector(out, scene.sphere_materials);
+	write_vector(out, scene.planes);
+	write_vector(out, scene.plane_materials);
+	write_vector(out, scene.directional_lights);
+	write_vector(out, scene.area_lights);
+	write_vector(out, scene.area_light_data);
+
+	auto tiles = static_cast<std::uint64_t>(record.tile_entities.size());
+	out.write(reinterpret_cast<const char *>(&tiles), sizeof(tiles));
+	for (const auto &entities : record.tile_entities) write_vector(out, entities);
+	write_vector(out, record.tiles_filled);
+	write_vector(out, record.colors);
+
+	return static_cast<bool>(out.flush());
+}
+
+bool load_frame_record(const std::string &path, FrameRecord &record) {
+	std::ifstream in(path, std::ios::binary);
+	char magic[4];
+	if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + 4, kRecordMagic)) return false;
+	if (!in.read(reinterpret_cast<char *>(&record.cam), sizeof(record.cam)) ||
+		!in.read(reinterpret_cast<char *>(&record.cfg), sizeof(record.cfg)) ||
+		!in.read(reinterpret_cast<char *>(&record.lightmaps), sizeof(record.lightmaps)))
+		return false;
+
+	auto &scene = record.scene;
+	if (!in.read(reinterpret_cast<char *>(&scene.next_entity_id), sizeof(scene.next_entity_id)) ||
+		!read_vector(in, scene.spheres) || !read_vector(in, scene.sphere_materials) || !read_vector(in, scene.planes) ||
+		!read_vector(in, scene.plane_materials) || !read_vector(in, scene.directional_lights) ||
+		!read_vector(in, scene.area_lights) || !read_vector(in, scene.area_light_data))
+		return false;
+
+	std::uint64_t tiles;
+	if (!in.read(reinterpret_cast<char *>(&tiles), sizeof(tiles)) || tiles > (std::uint64_t(1) << 24)) return false;
+	record.tile_entities.resize(tiles);
+	for (auto &entities : record.tile_entities)
+		if (!read_vector(in, entities)) return false;
+	return read_vector(in, record.tiles_filled) && read_vector(in, record.colors);
+}
+
+struct EntityState {
+	std::uint64_t hash;
+	bool bounded; // infinite planes are not
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+static std::map<EntityId, EntityState> entity_states(const Scene &scene) {
+	std::map<EntityId, EntityState> states;
+
+	for (auto i = 0; i < scene.spheres.size(); ++i) {
+		const auto &sphere = scene.spheres[i];
+		ContentHash hash;
+		hash.add(sphere.position);
+		hash.add(sphere.radius);
+		hash_material(hash, scene.sphere_materials[i]);
+		states[sphere.id] = EntityState{
+				.hash = hash.value,
+				.bounded = true,
+				.min = sphere.position - sphere.radius,
+				.max = sphere.position + sphere.radius,
+		};
+	}
+
+	for (auto i = 0; i < scene.planes.size(); ++i) {
+		const auto &plane = scene.planes[i];
+		ContentHash hash;
+		hash_plane(hash, plane);
+		hash_material(hash, scene.plane_materials[i]);
+
+		auto state = EntityState{.hash = hash.value, .bounded = plane.width != INFINITY && plane.height != INFINITY};
+		if (state.bounded) {
+			auto u = plane.bi_tangent * (plane.width * .5f);
+			auto v = plane.tangent * (plane.height * .5f);
+			state.min = state.max = plane.position - u - v;
+			for (const auto &corner : {plane.position + u - v, plane.position - u + v, plane.position + u + v}) {
+				state.min = glm::min(state.min, corner);
+				state.max = glm::max(state.max, corner);
+			}
+		}
+		states[plane.id] = state;
+	}
+	return states;
+}
+
+static std::uint64_t lights_hash(const Scene &scene) {
+	ContentHash hash;
+	for (const auto &light : scene.directional_lights) {
+		hash.add(light.direction);
+		hash.add(light.color);
+		hash.add(light.intensity);
+	}
+	for (auto i = 0; i < scene.area_lights.size(); ++i) {
+		const auto &data = scene.area_light_data[i];
+		hash_plane(hash, scene.area_lights[i]);
+		hash.add(data.color);
+		hash.add(data.intensity);
+		hash.add(static_cast<std::int64_t>(data.u_samples));
+		hash.add(static_cast<std::int64_t>(data.v_samples));
+		hash.add(data.max_random_offset);
+	}
+	return hash.value;
+}
+
+// pixel area (x0, y0, x1, y1) of the box on screen in image_tiles coordinates, the whole screen if part of the box is
+// behind the camera
+static glm::vec4 screen_bounds(const Camera &cam, const Config &cfg, const EntityState &state) {
+	auto whole_screen = glm::vec4(0, 0, cfg.width, cfg.height);
+	if (!state.bounded) return whole_screen;
+
+	auto forward = cam.lower_left_corner + cam.span_horizontal * .5f + cam.span_vertical * .5f - cam.position;
+	auto rect = glm::vec4(INFINITY, INFINITY, -INFINITY, -INFINITY);
+
+	for (auto i = 0; i < 8; ++i) {
+		auto corner = glm::vec3(i & 1 ? state.max.x : state.min.x, i & 2 ? state.max.y : state.min.y,
+								i & 4 ? state.max.z : state.min.z);
+		auto d = corner - cam.position;
+		auto depth = glm::dot(d, forward);
+		if (depth <= EPSILON) return whole_screen;
+
+		auto on_plane = cam.position + d / depth - cam.lower_left_corner;
+		auto x = glm::dot(on_plane, cam.span_horizontal) / glm::dot(cam.span_horizontal, cam.span_horizontal);
+		auto y = glm::dot(on_plane, cam.span_vertical) / glm::dot(cam.span_vertical, cam.span_vertical);
+		rect = glm::vec4(glm::min(rect.x, x * cfg.width), glm::min(rect.y, y * cfg.height),
+						 glm::max(rect.z, x * cfg.width), glm::max(rect.w, y * cfg.height));
+	}
+	// a pixel of margin for the samples that jitter across pixel borders
+	return glm::vec4(rect.x - 1, rect.y - 1, rect.z + 1, rect.w + 1);
+}
+
+static bool same_config(const Config &a, const Config &b) {
+	return a.width == b.width && a.height == b.height && a.samples_base == b.samples_base &&
+		   a.max_depth == b.max_depth && a.ambient_occlusion_samples == b.ambient_occlusion_samples &&
+		   a.tile_size == b.tile_size && a.seed == b.seed && a.irradiance_error == b.irradiance_error &&
+		   a.ao_cache_cell == b.ao_cache_cell && a.ao_cache_confidence == b.ao_cache_confidence &&
+		   a.guiding_passes == b.guiding_passes && a.integrator == b.integrator &&
+		   a.resample_lights == b.resample_lights;
+}
+
+static bool same_camera(const Camera &a, const Camera &b) {
+	ContentHash ha, hb;
+	hash_camera(ha, a);
+	hash_camera(hb, b);
+	return ha.value == hb.value;
+}
+
+Invalidation invalidate_tiles(const FrameRecord &previous, const Scene &scene, const Camera &cam, const Config &cfg,
+							  std::uint64_t lightmaps) {
+	auto tiles = image_tiles(cfg);
+	Invalidation result{.tiles = std::vector<bool>(tiles.size(), true)};
+
+	auto full = [&result](std::string reason) {
+		std::fill(result.tiles.begin(), result.tiles.end(), true);
+		result.full = true;
+		result.reason = std::move(reason);
+		return result;
+	};
+
+	if (!same_config(previous.cfg, cfg)) return full("config changed");
+	if (!same_camera(previous.cam, cam)) return full("camera moved");
+	if (previous.lightmaps != lightmaps) return full("lightmaps changed");
+	if (previous.tile_entities.size() != tiles.size() || previous.tiles_filled.size() != tiles.size() ||
+		previous.colors.size() != cfg.width * cfg.height)
+		return full("frame record does not match the image");
+	if (lights_hash(previous.scene) != lights_hash(scene)) return full("lights changed");
+
+	auto before = entity_states(previous.scene);
+	auto after = entity_states(scene);
+
+	std::vector<glm::vec4> changed_bounds;
+	for (const auto &[id, state] : before) {
+		auto it = after.find(id);
+		if (it != after.end() && it->second.hash == state.hash) continue;
+		result.changed_entities.push_back(id);
+		changed_bounds.push_back(screen_bounds(cam, cfg, state));
+		if (it != after.end()) changed_bounds.push_back(screen_bounds(cam, cfg, it->second));
+	}
+	for (const auto &[id, state] : after) {
+		if (before.contains(id)) continue;
+		result.changed_entities.push_back(id);
+		changed_bounds.push_back(screen_bounds(cam, cfg, state));
+	}
+	std::sort(result.changed_entities.begin(), result.changed_entities.end());
+
+	auto invalidated = 0;
+	for (auto i = 0; i < tiles.size(); ++i) {
+		const auto &rect = tiles[i];
+		const auto &entities = previous.tile_entities[i];
+
+		auto touched = std::any_of(entities.begin(), entities.end(), [&result](EntityId id) {
+			return std::binary_search(result.changed_entities.begin(), result.changed_entities.end(), id);
+		});
+		auto overlaps = std::any_of(changed_bounds.begin(), changed_bounds.end(), [&rect](const glm::vec4 &b) {
+			return b.x < rect.z && b.z > rect.x && b.y < rect.w && b.w > rect.y;
+		});
+
+		result.tiles[i] = touched || overlaps;
+		invalidated += result.tiles[i];
+	}
+
+	if (invalidated > kFullRenderFraction * tiles.size())
+		return full("edit reaches " + std::to_string(invalidated) + "/" + std::to_string(tiles.size()) + " tiles");
+
+	// only a preview of these was rendered, whatever the edit
+	for (auto i = 0; i < tiles.size(); ++i)
+		if (previous.tiles_filled[i]) result.tiles[i] = true;
+	return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "camera.h"
+#include "config.h"
+#include "scene.h"
+
+// incremental re-rendering after scene edits. a frame record keeps what a frame was rendered from, its colors and
+// the entities the rays of every tile hit. after an edit only the tiles that hit a changed entity, or whose screen
+// area overlaps the old or new bounds of one, are rendered again. light, camera, config and lightmap edits fall back
+// to a full render, and so do edits that reach most tiles anyway, which is what indirect light usually leads to.
+// shadows an edit casts onto tiles whose rays never hit the changed entity are missed. tiles filled in after a
+// deadline are always rendered again.
+
+struct FrameRecord {
+	Scene scene;
+	Camera cam;
+	Config cfg;
+	std::uint64_t lightmaps = 0; // lightmaps_hash of the lightmaps the frame was shaded from, 0 without
+	std::vector<std::vector<EntityId>> tile_entities; // indexed like image_tiles
+	std::vector<char> tiles_filled; // indexed like image_tiles, RenderingTask::tiles_filled of the frame
+	std::vector<glm::vec3> colors; // linear, top row first
+};
+
+// records are raw copies of the scene structs, only meant to be read back by the same build
+bool save_frame_record(const std::string &path, const FrameRecord &record);
+bool load_frame_record(const std::string &path, FrameRecord &record);
+
+struct Invalidation {
+	std::vector<bool> tiles; // indexed like image_tiles, set for every tile to render again
+	std::vector<EntityId> changed_entities;
+	bool full = false;
+	std::string reason; // why everything is rendered again
+};
+
+// lightmaps like FrameRecord::lightmaps for the frame about to be rendered
+Invalidation invalidate_tiles(const FrameRecord &previous, const Scene &scene, const Camera &cam, const Config &cfg,
+							  std::uint64_t lightmaps);
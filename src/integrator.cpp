@@ -0,0 +1,63 @@
+#include "integrator.h"
+
+#include <optional>
+
+#include <glm/glm.hpp>
+
+#include "bidirectional.h"
+#include "config.h"
+#include "context.h"
+#include "scene.h"
+
+// surface the camera ray hits, and the path ends there either way
+static std::optional<HitRecord> camera_hit(const Ray &ray, const Scene &scene, const RenderContext &context,
+										   Stats &stats) {
+	++stats.path_length[1];
+	auto closest = hit_scene(ray, scene, context, stats);
+	if (!closest) return std::nullopt;
+	return surface_attributes(ray, scene, *closest);
+}
+
+glm::vec3 ambient_occlusion_color(const Ray &ray, const Camera &camera, const Scene &scene, const Config &cfg,
+								  const RenderContext &context, Stats &stats, int max_depth) {
+	auto hit = camera_hit(ray, scene, context, stats);
+	if (!hit || !hit->front_facing) return glm::vec3(0);
+
+	// without occlusion rays the preview would be plain white
+	auto occlusion_cfg = cfg;
+	occlusion_cfg.ambient_occlusion_samples = glm::max(cfg.ambient_occlusion_samples, 1);
+	return glm::vec3(1.f - sample_ambient_occlusion(*hit, scene, occlusion_cfg, context, stats, 0));
+}
+
+glm::vec3 albedo_color(const Ray &ray, const Camera &camera, const Scene &scene, const Config &cfg,
+					   const RenderContext &context, Stats &stats, int max_depth) {
+	auto hit = camera_hit(ray, scene, context, stats);
+	return hit ? hit->material->color : glm::vec3(0);
+}
+
+glm::vec3 normal_color(const Ray &ray, const Camera &camera, const Scene &scene, const Config &cfg,
+					   const RenderContext &context, Stats &stats, int max_depth) {
+	auto hit = camera_hit(ray, scene, context, stats);
+	return hit ? hit->normal * .5f + .5f : glm::vec3(0);
+}
+
+RayColorFn select_integrator(const Scene &scene, const Config &cfg) {
+	switch (cfg.integrator) {
+	case Integrator::kBidirectional:
+		return bidirectional_color;
+	case Integrator::kAmbientOcclusion:
+		return ambient_occlusion_color;
+	case Integrator::kDirect: {
+		auto direct = cfg;
+		direct.max_depth = 1;
+		return select_ray_color(scene, direct);
+	}
+	case Integrator::kAlbedo:
+		return albedo_color;
+	case Integrator::kNormal:
+		return normal_color;
+	case Integrator::kPath:
+		break;
+	}
+	return select_ray_color(scene, cfg);
+}
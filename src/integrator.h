@@ -0,0 +1,26 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include "ray.h"
+
+// integrators share the signature of ray_color, a RayColorFn, and are picked by cfg.integrator. besides ray_color and
+// bidirectional_color there are previews for checking the layout of a scene, they trace the camera ray and at most
+// the ambient occlusion rays of its hit
+
+// white surfaces darkened by the ambient occlusion of cfg.ambient_occlusion_samples rays, at least one
+glm::vec3 ambient_occlusion_color(const Ray &ray, const struct Camera &camera, const Scene &scene,
+								  const struct Config &cfg, const struct RenderContext &context, Stats &stats,
+								  int max_depth);
+
+// color of the material hit, lit or not
+glm::vec3 albedo_color(const Ray &ray, const struct Camera &camera, const Scene &scene, const struct Config &cfg,
+					   const struct RenderContext &context, Stats &stats, int max_depth);
+
+// normal of the surface hit, mapped from [-1, 1] to [0, 1] per axis
+glm::vec3 normal_color(const Ray &ray, const struct Camera &camera, const Scene &scene, const struct Config &cfg,
+					   const struct RenderContext &context, Stats &stats, int max_depth);
+
+// integrator cfg.integrator asks for. direct light is the ray_color kernel without indirect bounces, generate_image
+// leaves its lightmaps out
+RayColorFn select_integrator(const Scene &scene, const struct Config &cfg);
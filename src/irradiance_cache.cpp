@@ -0,0 +1,111 @@
+#include "irradiance_cache.h"
+
+#include <mutex>
+
+#include <glm/glm.hpp>
+
+// octree levels below the root, deeper nodes would hold records smaller than min_radius anyway
+static constexpr int kMaxDepth = 16;
+
+IrradianceCache::IrradianceCache(const glm::vec3 &min, const glm::vec3 &max, float error) : error(error) {
+	auto extent = (max - min) * .5f;
+	root.center = (min + max) * .5f;
+	root.half_size = glm::max(1.f, glm::max(extent.x, glm::max(extent.y, extent.z))) * 1.01f;
+
+	min_radius = root.half_size * .01f;
+	max_radius = root.half_size * .25f;
+}
+
+static bool contains(const glm::vec3 &center, float half_size, const glm::vec3 &position) {
+	auto d = glm::abs(position - center);
+	return d.x <= half_size && d.y <= half_size && d.z <= half_size;
+}
+
+bool IrradianceCache::lookup(const glm::vec3 &position, const glm::vec3 &normal, glm::vec3 &irradiance) const {
+	std::shared_lock lock(mutex);
+
+	auto weights = 0.f;
+	glm::vec3 sum(0.f);
+
+	auto add_records = [&](const Node &node) {
+		for (const auto &record : node.records) {
+			auto d = position - record.position;
+			// records in front of the point see a different hemisphere
+			if (glm::dot(d, (normal + record.normal) * .5f) < -.01f * record.radius) continue;
+
+			auto inverse_weight = glm::length(d) / record.radius +
+								  glm::sqrt(glm::max(0.f, 1.f - glm::dot(normal, record.normal)));
+			if (inverse_weight >= error) continue;
+			auto weight = 1.f / glm::max(inverse_weight, 1e-4f);
+
+			auto rotation = glm::cross(record.normal, normal);
+			auto extrapolated = record.irradiance;
+			for (auto c = 0; c < 3; ++c)
+				extrapolated[c] += glm::dot(rotation, record.rotation_gradient[c]) +
+								   glm::dot(d, record.translation_gradient[c]);
+
+			sum += glm::max(extrapolated, 0.f) * weight;
+			weights += weight;
+		}
+	};
+
+	// a record reaches at most the half size of its node past the node, so nodes are searched with that margin
+	std::vector<const Node *> stack{&root};
+	while (!stack.empty()) {
+		auto node = stack.back();
+		stack.pop_back();
+		add_records(*node);
+
+		for (const auto &child : node->children)
+			if (child && contains(child->center, child->half_size * 2.f, position)) stack.push_back(child.get());
+	}
+
+	if (weights <= 0.f) return false;
+	irradiance = sum / weights;
+	return true;
+}
+
+void IrradianceCache::insert(const IrradianceRecord &record) {
+	std::unique_lock lock(mutex);
+
+	auto node = &root;
+	auto reach = record.radius * error;
+	if (contains(root.center, root.half_size, record.position)) {
+		for (auto depth = 0; depth < kMaxDepth && node->half_size * .5f >= reach; ++depth) {
+			auto above = glm::vec3(record.position.x > node->center.x, record.position.y > node->center.y,
+								   record.position.z > node->center.z);
+			auto &child = node->children[int(above.x) | int(above.y) << 1 | int(above.z) << 2];
+			if (!child) {
+				auto half_size = node->half_size * .5f;
+				child = std::make_unique<Node>();
+				child->center = node->center + (above * 2.f - 1.f) * half_size;
+				child->half_size = half_size;
+			}
+			node = child.get();
+		}
+	}
+	node->records.push_back(record);
+	++records;
+}
+
+void scene_bounds(const Scene &scene, glm::vec3 &min, glm::vec3 &max) {
+	min = glm::vec3(INFINITY);
+	max = glm::vec3(-INFINITY);
+
+	for (const auto &sphere : scene.spheres) {
+		min = glm::min(min, sphere.position - sphere.radius);
+		max = glm::max(max, sphere.position + sphere.radius);
+	}
+	for (const auto &plane : scene.planes) {
+		if (plane.width == INFINITY || plane.height == INFINITY) continue;
+		auto u = plane.bi_tangent * (plane.width * .5f);
+		auto v = plane.tangent * (plane.height * .5f);
+		for (const auto &corner : {plane.position - u - v, plane.position + u - v, plane.position - u + v,
+								   plane.position + u + v}) {
+			min = glm::min(min, corner);
+			max = glm::max(max, corner);
+		}
+	}
+
+	if (min.x > max.x) min = max = glm::vec3(0);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "scene.h"
+
+// ward style irradiance cache for the first indirect bounce. a record samples the hemisphere above a point once and
+// is reused by every later hit within its validity radius, extrapolated with its rotation and translation gradients.
+// "irradiance" is whatever ray_color multiplies with the surface color / PI. ray_color clamps direct plus indirect
+// light of every path to one, so a record averages its samples after cutting each to what that clamp lets through
+// over the direct light where it was taken, which keeps cached and traced bounces at the same mean.
+// records depend on which thread got to a spot first, frames rendered with the cache are not repeatable
+
+// strata of a record, cosine weighted in theta and uniform in phi, n = pi * m as ward suggests
+static constexpr int kIrradianceStrataTheta = 6;
+static constexpr int kIrradianceStrataPhi = 18;
+
+struct IrradianceRecord {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec3 irradiance;
+	float radius; // harmonic mean distance to what the hemisphere rays hit, clamped
+
+	// one gradient per color channel
+	std::array<glm::vec3, 3> rotation_gradient;
+	std::array<glm::vec3, 3> translation_gradient;
+};
+
+class IrradianceCache {
+public:
+	// records are sorted into an octree over min to max, records outside stay in the root. error is ward's a, the
+	// share of its radius a record is trusted for
+	IrradianceCache(const glm::vec3 &min, const glm::vec3 &max, float error);
+
+	// interpolates the records valid at position and normal, false if there are none
+	bool lookup(const glm::vec3 &position, const glm::vec3 &normal, glm::vec3 &irradiance) const;
+
+	void insert(const IrradianceRecord &record);
+
+	std::size_t size() const { return records; }
+
+	// range record radii are clamped to, from the size of the octree
+	float min_radius;
+	float max_radius;
+
+private:
+	struct Node {
+		glm::vec3 center;
+		float half_size;
+		std::array<std::unique_ptr<Node>, 8> children;
+		std::vector<IrradianceRecord> records;
+	};
+
+	float error;
+	Node root;
+	std::atomic<std::size_t> records = 0;
+	mutable std::shared_mutex mutex;
+};
+
+// bounds of the spheres and finite planes of scene, what an irradiance cache for it is built over
+void scene_bounds(const Scene &scene, glm::vec3 &min, glm::vec3 &max);
@@ -0,0 +1,180 @@
+#include "lightmap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <thread>
+#include <utility>
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "context.h"
+#include "hash.h"
+#include "math.h"
+#include "ray.h"
+#include "render.h"
+#include "serialize.h"
+
+static constexpr char kLightmapMagic[4] = {'R', 'T', 'L', 'M'};
+
+// texels per side of a plane, keeps the texel index of a plane in 16 bits per axis
+static constexpr int kMaxTexels = 4096;
+
+bool bakes_plane(const Scene &scene, int plane) {
+	const auto &p = scene.planes[plane];
+	const auto &material = scene.plane_materials[plane];
+	if (p.width == INFINITY || p.height == INFINITY || material.type != MaterialType::kBlinnPhong) return false;
+	// blinn_phong only adds a highlight for a positive shininess
+	return material.blinnPhong.shininess <= 0.f || material.blinnPhong.specular_intensity == 0.f;
+}
+
+static std::uint64_t scene_hash(const Scene &scene) {
+	ContentHash hash;
+	hash_scene(hash, scene);
+	return hash.value;
+}
+
+static std::uint16_t texel_count(float size, float texel_size) {
+	return static_cast<std::uint16_t>(glm::clamp(static_cast<int>(std::ceil(size / texel_size)), 1, kMaxTexels));
+}
+
+// center of the texel at u, v moved by jitter, in texels
+static glm::vec3 texel_position(const Plane &plane, const PlaneLightmap &map, int u, int v, const glm::vec2 &jitter) {
+	auto s = (u + jitter.x) / map.width - .5f;
+	auto t = (v + jitter.y) / map.height - .5f;
+	return plane.position + plane.bi_tangent * (s * plane.width) + plane.tangent * (t * plane.height);
+}
+
+void bake_lightmaps(const Scene &scene, const Config &cfg, float texel_size, Lightmaps &lightmaps, Stats &stats) {
+	auto samples_base = glm::max(cfg.samples_base, 1);
+	auto samples2 = samples_base * samples_base;
+
+	lightmaps.scene_hash = scene_hash(scene);
+	lightmaps.texel_size = texel_size;
+	lightmaps.planes.assign(scene.planes.size(), PlaneLightmap{});
+
+	// every texel row of every baked plane is a unit of work, rows are seeded on their own so a bake comes out the
+	// same on any number of threads
+	std::vector<std::pair<int, int>> rows;
+	std::uint32_t texels = 0;
+	for (auto i = 0; i < scene.planes.size(); ++i) {
+		if (!bakes_plane(scene, i)) continue;
+		const auto &plane = scene.planes[i];
+		auto &map = lightmaps.planes[i];
+		map.first_texel = texels;
+		map.width = texel_count(plane.width, texel_size);
+		map.height = texel_count(plane.height, texel_size);
+		texels += map.width * map.height;
+		for (auto v = 0; v < map.height; ++v) rows.emplace_back(i, v);
+	}
+	lightmaps.texels.assign(texels, glm::vec3(0));
+
+	// only lambert planes are baked, the camera of blinn_phong never comes into play
+	Camera camera{};
+	std::atomic<std::size_t> next_row = 0;
+	// nothing is cached or baked yet while baking
+	const RenderContext context;
+	auto bake_rows = [&](Stats &thread_stats) {
+		for (auto row = next_row++; row < rows.size(); row = next_row++) {
+			auto [index, v] = rows[row];
+			const auto &plane = scene.planes[index];
+			const auto &map = lightmaps.planes[index];
+
+			ContentHash seed;
+			seed.add(static_cast<std::int64_t>(cfg.seed));
+			seed.add(static_cast<std::int64_t>(index));
+			seed.add(static_cast<std::int64_t>(v));
+			seed_random(static_cast<std::uint32_t>(seed.value));
+
+			// a white copy of the material leaves the surface color to whoever samples the lightmap
+			auto white = scene.plane_materials[index];
+			white.color = glm::vec3(1);
+			auto hit = HitRecord{
+					.entity_id = plane.id,
+					.distance = 0,
+					.normal = plane.normal,
+					.tangent = plane.tangent,
+					.front_facing = true,
+					.material = &white,
+			};
+
+			for (auto u = 0; u < map.width; ++u) {
+				glm::vec3 light(0.f);
+				for (auto i = 0; i < samples2; ++i) {
+					auto jitter = glm::vec2((i % samples_base) + rand_float(), (i / samples_base) + rand_float());
+					hit.position = texel_position(plane, map, u, v, jitter / static_cast<float>(samples_base));
+					light += shade_surface(hit, camera, scene, cfg, context, thread_stats, cfg.max_depth);
+				}
+				lightmaps.texels[map.first_texel + v * map.width + u] = light / static_cast<float>(samples2);
+			}
+		}
+	};
+
+	auto threads = render_thread_count(cfg);
+	std::vector<Stats> thread_stats(threads);
+	std::vector<std::thread> workers;
+	for (auto i = 0; i < threads; ++i) workers.emplace_back(bake_rows, std::ref(thread_stats[i]));
+	for (auto &worker : workers) worker.join();
+	for (const auto &s : thread_stats) stats.merge(s);
+}
+
+bool sample_lightmap(const Lightmaps &lightmaps, const Scene &scene, int plane, const glm::vec3 &position,
+					 glm::vec3 &light) {
+	const auto &map = lightmaps.planes[plane];
+	if (map.width == 0) return false;
+	const auto &p = scene.planes[plane];
+
+	// texel centers sit at half texels, positions past the outer centers take the border texels
+	auto d = position - p.position;
+	auto s = glm::clamp((glm::dot(d, p.bi_tangent) / p.width + .5f) * map.width - .5f, 0.f, map.width - 1.f);
+	auto t = glm::clamp((glm::dot(d, p.tangent) / p.height + .5f) * map.height - .5f, 0.f, map.height - 1.f);
+
+	auto u0 = static_cast<int>(s);
+	auto v0 = static_cast<int>(t);
+	auto u1 = glm::min(u0 + 1, map.width - 1);
+	auto v1 = glm::min(v0 + 1, map.height - 1);
+	auto fu = s - u0;
+	auto fv = t - v0;
+
+	const auto *texels = lightmaps.texels.data() + map.first_texel;
+	auto bottom = texels[v0 * map.width + u0] * (1.f - fu) + texels[v0 * map.width + u1] * fu;
+	auto top = texels[v1 * map.width + u0] * (1.f - fu) + texels[v1 * map.width + u1] * fu;
+	light = bottom * (1.f - fv) + top * fv;
+	return true;
+}
+
+bool lightmaps_match(const Lightmaps &lightmaps, const Scene &scene) {
+	return lightmaps.planes.size() == scene.planes.size() && lightmaps.scene_hash == scene_hash(scene);
+}
+
+std::uint64_t lightmaps_hash(const Lightmaps &lightmaps) {
+	ContentHash hash;
+	hash.add(lightmaps.texels.data(), lightmaps.texels.size() * sizeof(glm::vec3));
+	return hash.value;
+}
+
+bool save_lightmaps(const std::string &path, const Lightmaps &lightmaps) {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(kLightmapMagic, sizeof(kLightmapMagic));
+	out.write(reinterpret_cast<const char *>(&lightmaps.scene_hash), sizeof(lightmaps.scene_hash));
+	out.write(reinterpret_cast<const char *>(&lightmaps.texel_size), sizeof(lightmaps.texel_size));
+	write_vector(out, lightmaps.planes);
+	write_vector(out, lightmaps.texels);
+	return static_cast<bool>(out.flush());
+}
+
+bool load_lightmaps(const std::string &path, Lightmaps &lightmaps) {
+	std::ifstream in(path, std::ios::binary);
+	char magic[4];
+	if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + 4, kLightmapMagic)) return false;
+	if (!in.read(reinterpret_cast<char *>(&lightmaps.scene_hash), sizeof(lightmaps.scene_hash)) ||
+		!in.read(reinterpret_cast<char *>(&lightmaps.texel_size), sizeof(lightmaps.texel_size)))
+		return false;
+	if (!read_vector(in, lightmaps.planes) || !read_vector(in, lightmaps.texels)) return false;
+
+	return std::ranges::all_of(lightmaps.planes, [&](const PlaneLightmap &map) {
+		return map.first_texel + std::size_t(map.width) * map.height <= lightmaps.texels.size();
+	});
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "config.h"
+#include "scene.h"
+
+// light baked into texel grids over the front of planes, laid out along bi_tangent (width) and tangent (height).
+// a texel holds what shade_surface returns there for a surface color of one, so ray_color shades a baked plane by
+// multiplying the lightmap with its color instead of tracing light and indirect rays. only planes whose shading does
+// not depend on the view are baked, see bakes_plane
+
+struct PlaneLightmap {
+	std::uint32_t first_texel = 0; // into Lightmaps::texels, rows along the tangent
+	std::uint16_t width = 0; // texels along the bi_tangent, 0 for planes that are not baked
+	std::uint16_t height = 0;
+};
+
+struct Lightmaps {
+	std::uint64_t scene_hash; // hash_scene of what was baked, any edit makes the bake stale
+	float texel_size;
+
+	std::vector<PlaneLightmap> planes; // indexed like scene.planes
+	std::vector<glm::vec3> texels;
+};
+
+// finite, lit and without a specular highlight
+bool bakes_plane(const Scene &scene, int plane);
+
+// bakes cfg.samples_base^2 samples per texel of texel_size, traced to cfg.max_depth, on render_thread_count threads
+void bake_lightmaps(const Scene &scene, const Config &cfg, float texel_size, Lightmaps &lightmaps, Stats &stats);
+
+// light at position on plane, interpolated between texel centers. false if the plane has no lightmap
+bool sample_lightmap(const Lightmaps &lightmaps, const Scene &scene, int plane, const glm::vec3 &position,
+					 glm::vec3 &light);
+
+// whether lightmaps were baked for scene as it is
+bool lightmaps_match(const Lightmaps &lightmaps, const Scene &scene);
+
+// hash of the baked light, what a frame shaded from lightmaps depends on besides its scene, camera and config
+std::uint64_t lightmaps_hash(const Lightmaps &lightmaps);
+
+// raw copies, only meant to be read back by the same build
+bool save_lightmaps(const std::string &path, const Lightmaps &lightmaps);
+bool load_lightmaps(const std::string &path, Lightmaps &lightmaps);
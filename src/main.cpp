@@ -1,208 +1,523 @@
-#include <atomic>
+#include <algorithm>
 #include <chrono>
+#include <optional>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
-#include <thread>
-#include <queue>
-#include <mutex>
+#include <string>
+#include <vector>
 
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
+#include <unistd.h>
 
+#include "cache.h"
 #include "camera.h"
+#include "checkpoint.h"
 #include "config.h"
-#include "ray.h"
+#include "cpu.h"
+#include "distributed.h"
+#include "image.h"
+#include "incremental.h"
+#include "lightmap.h"
+#include "perf.h"
+#include "relight.h"
+#include "render.h"
 #include "scene.h"
+#include "scenes.h"
+#include "server.h"
+#include "trace.h"
+#include "tuning.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include "stb_image_write.h"
 
-struct RenderingTask {
-	const Config &cfg;
-	const Camera &cam;
-	const Scene &scene;
-
-	Stats stats;
-	char *pixel_buffer;
-
-	std::mutex queue_mutex;
-	std::queue<glm::ivec4> rectangles;
+struct Options {
+	Config cfg;
+	std::string scene = "cornell_box";
+	std::string output = "test.bmp";
+	std::string trace_path;
+	std::string heatmap_prefix;
+	bool print_stats = false;
+	bool perf_counters = false;
+	std::string socket_path;
+	std::string checkpoint_path;
+	int checkpoint_interval_s = 60;
+	bool resume = false;
+	int deadline_ms = 0;
+	std::string cache_dir;
+	int cache_size_mb = 1024;
+	bool worker = false;
+	bool distributed = false;
+	CoordinatorOptions coordinator;
+	std::string tuning_path; // defaults to the scene's default_tuning_path
+	bool use_tuning = true;
+	std::optional<TuningObjective> autotune;
+	std::string incremental_path;
+	bool print_entities = false;
+	struct {
+		EntityId first = NULL_ENTITY;
+		EntityId last = NULL_ENTITY;
+		glm::vec3 offset{0};
+	} translate;
+	std::string capture_path;
+	std::string relight_path;
+	std::vector<std::pair<EntityId, glm::vec3>> material_colors;
+	std::vector<std::pair<EntityId, MaterialBlinnPhong>> material_phong;
+	std::vector<std::pair<int, float>> light_intensities; // directional lights first, then area lights
+	std::string bake_path;
+	float lightmap_texel = .1f;
+	std::string lightmap_path;
 };
 
-void generate_image_part(RenderingTask &task) {
-	auto pixel_size_x = 1.f / task.cfg.width / task.cfg.samples_base;
-	auto pixel_size_y = 1.f / task.cfg.height / task.cfg.samples_base;
-	auto samples2 = static_cast<float>(task.cfg.samples_base * task.cfg.samples_base);
-
-	while (true) {
-		glm::ivec4 rect;
+static void print_usage() {
+	std::cerr << "usage: raytracer [--scene name] [--width n] [--height n] [--samples n] [--depth n] [--ao n]\n"
+			  << "                 [--threads n] [--tuning file | --no-tuning] [--output file.bmp]\n"
+			  << "                 [--trace trace.json] [--heatmap prefix] [--stats]\n"
+			  << "                 [--perf] [--seed n] [--deadline ms] [--irradiance-cache error]\n"
+			  << "                 [--ao-cache cell [--ao-cache-confidence rays]] [--guiding passes]\n"
+			  << "                 [--integrator path|bidirectional|ao|direct|albedo|normal]\n"
+			  << "                 [--resample-lights]\n"
+			  << "                 [--checkpoint file [--checkpoint-interval s] [--resume]]\n"
+			  << "                 [--cache dir [--cache-size mb]] [--incremental file]\n"
+			  << "                 [--translate first-last dx,dy,dz] [--entities] [--lightmaps file]\n"
+			  << "       raytracer --bake lightmaps [--lightmap-texel size] [--scene name] [--samples n] [--depth n]\n"
+			  << "                 [--ao n] [--threads n]\n"
+			  << "       raytracer --capture gbuffer | --relight gbuffer [--scene name] [--color id r,g,b]\n"
+			  << "                 [--phong id diffuse,specular,shininess] [--light-intensity light value]\n"
+			  << "                 [--output file.bmp] [--width n] [--height n] [--samples n] [--depth n] [--ao n]\n"
+			  << "       raytracer --autotune throughput|error [--scene name] [--width n] [--height n] [--samples n]\n"
+			  << "                 [--depth n] [--ao n] [--tuning file]\n"
+			  << "       raytracer --serve socket [--threads n] [--samples n] [--depth n] [--ao n]\n"
+			  << "       raytracer --distributed workers [--worker-command cmd] [--tile-timeout ms] [--width n]\n"
+			  << "                 [--height n] [--samples n] [--depth n] [--ao n] [--output file.bmp]\n"
+			  << "       raytracer --worker" << std::endl;
+}
 
-		{
-			const std::lock_guard guard(task.queue_mutex);
-			if (task.rectangles.empty()) break;
-			rect = task.rectangles.front();
-			task.rectangles.pop();
+static bool parse_args(int argc, char **argv, Options &options) {
+	for (auto i = 1; i < argc; ++i) {
+		auto has_value = i + 1 < argc;
+		if (!strcmp(argv[i], "--scene") && has_value) options.scene = options.coordinator.scene = argv[++i];
+		else if (!strcmp(argv[i], "--width") && has_value) options.cfg.width = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--height") && has_value) options.cfg.height = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--samples") && has_value) options.cfg.samples_base = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--depth") && has_value) options.cfg.max_depth = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--ao") && has_value) options.cfg.ambient_occlusion_samples = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && has_value) options.cfg.threads = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--irradiance-cache") && has_value)
+			options.cfg.irradiance_error = std::stof(argv[++i]);
+		else if (!strcmp(argv[i], "--ao-cache") && has_value) options.cfg.ao_cache_cell = std::stof(argv[++i]);
+		else if (!strcmp(argv[i], "--ao-cache-confidence") && has_value)
+			options.cfg.ao_cache_confidence = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--guiding") && has_value) options.cfg.guiding_passes = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--integrator") && has_value) {
+			std::string integrator = argv[++i];
+			if (integrator == "path") options.cfg.integrator = Integrator::kPath;
+			else if (integrator == "bidirectional") options.cfg.integrator = Integrator::kBidirectional;
+			else if (integrator == "ao") options.cfg.integrator = Integrator::kAmbientOcclusion;
+			else if (integrator == "direct") options.cfg.integrator = Integrator::kDirect;
+			else if (integrator == "albedo") options.cfg.integrator = Integrator::kAlbedo;
+			else if (integrator == "normal") options.cfg.integrator = Integrator::kNormal;
+			else return false;
+		}
+		else if (!strcmp(argv[i], "--resample-lights")) options.cfg.resample_lights = true;
+		else if (!strcmp(argv[i], "--seed") && has_value) options.cfg.seed = std::stoul(argv[++i]);
+		else if (!strcmp(argv[i], "--output") && has_value) options.output = argv[++i];
+		else if (!strcmp(argv[i], "--trace") && has_value) options.trace_path = argv[++i];
+		else if (!strcmp(argv[i], "--heatmap") && has_value) options.heatmap_prefix = argv[++i];
+		else if (!strcmp(argv[i], "--stats")) options.print_stats = true;
+		else if (!strcmp(argv[i], "--perf")) options.perf_counters = true;
+		else if (!strcmp(argv[i], "--checkpoint") && has_value) options.checkpoint_path = argv[++i];
+		else if (!strcmp(argv[i], "--checkpoint-interval") && has_value)
+			options.checkpoint_interval_s = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--resume")) options.resume = true;
+		else if (!strcmp(argv[i], "--tuning") && has_value) options.tuning_path = argv[++i];
+		else if (!strcmp(argv[i], "--no-tuning")) options.use_tuning = false;
+		else if (!strcmp(argv[i], "--autotune") && has_value) {
+			std::string objective = argv[++i];
+			if (objective == "throughput") options.autotune = TuningObjective::kThroughput;
+			else if (objective == "error") options.autotune = TuningObjective::kEqualError;
+			else return false;
 		}
+		else if (!strcmp(argv[i], "--cache") && has_value) options.cache_dir = argv[++i];
+		else if (!strcmp(argv[i], "--cache-size") && has_value) options.cache_size_mb = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--incremental") && has_value) options.incremental_path = argv[++i];
+		else if (!strcmp(argv[i], "--entities")) options.print_entities = true;
+		else if (!strcmp(argv[i], "--translate") && i + 2 < argc) {
+			auto &translate = options.translate;
+			int first, last;
+			if (std::sscanf(argv[++i], "%d-%d", &first, &last) != 2 ||
+				std::sscanf(argv[++i], "%f,%f,%f", &translate.offset.x, &translate.offset.y, &translate.offset.z) != 3)
+				return false;
+			translate.first = static_cast<EntityId>(first);
+			translate.last = static_cast<EntityId>(last);
+		}
+		else if (!strcmp(argv[i], "--capture") && has_value) options.capture_path = argv[++i];
+		else if (!strcmp(argv[i], "--relight") && has_value) options.relight_path = argv[++i];
+		else if (!strcmp(argv[i], "--color") && i + 2 < argc) {
+			auto id = std::stoi(argv[++i]);
+			glm::vec3 color;
+			if (std::sscanf(argv[++i], "%f,%f,%f", &color.x, &color.y, &color.z) != 3) return false;
+			options.material_colors.emplace_back(static_cast<EntityId>(id), color);
+		} else if (!strcmp(argv[i], "--phong") && i + 2 < argc) {
+			auto id = std::stoi(argv[++i]);
+			MaterialBlinnPhong phong;
+			if (std::sscanf(argv[++i], "%f,%f,%f", &phong.diffuse_intensity, &phong.specular_intensity,
+							&phong.shininess) != 3)
+				return false;
+			options.material_phong.emplace_back(static_cast<EntityId>(id), phong);
+		} else if (!strcmp(argv[i], "--light-intensity") && i + 2 < argc) {
+			auto light = std::stoi(argv[++i]);
+			options.light_intensities.emplace_back(light, std::stof(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--bake") && has_value) options.bake_path = argv[++i];
+		else if (!strcmp(argv[i], "--lightmap-texel") && has_value) options.lightmap_texel = std::stof(argv[++i]);
+		else if (!strcmp(argv[i], "--lightmaps") && has_value) options.lightmap_path = argv[++i];
+		else if (!strcmp(argv[i], "--deadline") && has_value) options.deadline_ms = std::stoi(argv[++i]);
+		else if (!strcmp(argv[i], "--serve") && has_value) options.socket_path = argv[++i];
+		else if (!strcmp(argv[i], "--worker")) options.worker = true;
+		else if (!strcmp(argv[i], "--distributed") && has_value) {
+			options.distributed = true;
+			options.coordinator.workers = std::stoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--worker-command") && has_value) options.coordinator.worker_command = argv[++i];
+		else if (!strcmp(argv[i], "--tile-timeout") && has_value)
+			options.coordinator.tile_timeout_ms = std::stod(argv[++i]);
+		else return false;
+	}
+	return (!options.resume || !options.checkpoint_path.empty()) && options.lightmap_texel > 0;
+}
 
-		for (auto y = rect.y; y < rect.w; y++) {
-			for (auto x = rect.x; x < rect.z; x++) {
-				auto color = glm::vec3();
+static int render_distributed(const Options &options) {
+	const auto &cfg = options.cfg;
 
-				for (auto i = 0; i < samples2; ++i) {
-					auto u = static_cast<float>(x) / task.cfg.width;
-					auto v = static_cast<float>(y) / task.cfg.height;
+	auto start = std::chrono::high_resolution_clock::now();
+	auto result = run_coordinator(options.coordinator, cfg);
+	auto finish = std::chrono::high_resolution_clock::now();
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
+	std::cout << duration << "ms - " << (duration / 1000.f / 60.f) << "m" << std::endl;
+	std::cout << "rays: " << result.rays << std::endl;
+	std::cout << "reassigned tiles: " << result.reassigned_tiles << std::endl;
 
-					u += ((i % task.cfg.samples_base) + .5f) * pixel_size_x;
-					v += ((i / task.cfg.samples_base) + .5f) * pixel_size_y;
+	if (!result.complete) return 1;
+	stbi_write_bmp(options.output.c_str(), cfg.width, cfg.height, 3, result.pixels.data());
+	return 0;
+}
 
-					auto r = ray_from_camera(task.cam, u, v);
-					color += ray_color(r, task.cam, task.scene, task.cfg, task.stats, task.cfg.max_depth);
-				}
+static void print_entities(const Scene &scene) {
+	for (const auto &sphere : scene.spheres) {
+		std::cout << sphere.id << " sphere " << sphere.position.x << "," << sphere.position.y << ","
+				  << sphere.position.z << std::endl;
+	}
+	for (const auto &plane : scene.planes) {
+		std::cout << plane.id << " plane " << plane.position.x << "," << plane.position.y << "," << plane.position.z
+				  << std::endl;
+	}
+}
 
-				color /= samples2;
-				color = glm::clamp(color, 0.f, 1.f);
+static bool apply_edits(const Options &options, Scene &scene) {
+	for (const auto &[id, color] : options.material_colors) {
+		auto material = entity_material(scene, id);
+		if (!material) return false;
+		material->color = color;
+	}
+	for (const auto &[id, phong] : options.material_phong) {
+		auto material = entity_material(scene, id);
+		if (!material || material->type != MaterialType::kBlinnPhong) return false;
+		material->blinnPhong = phong;
+	}
 
-				auto p = task.pixel_buffer + ((task.cfg.height - y - 1) * task.cfg.width + x) * 3;
-				p[0] = static_cast<char>(255.99f * color.r);
-				p[1] = static_cast<char>(255.99f * color.g);
-				p[2] = static_cast<char>(255.99f * color.b);
-			}
-		}
+	auto directional = static_cast<int>(scene.directional_lights.size());
+	for (const auto &[light, intensity] : options.light_intensities) {
+		if (light < 0 || light >= directional + scene.area_light_data.size()) return false;
+		if (light < directional) scene.directional_lights[light].intensity = intensity;
+		else scene.area_light_data[light - directional].intensity = intensity;
 	}
+	return true;
 }
 
-void generate_image(RenderingTask &task) {
-	const auto cores = std::thread::hardware_concurrency();
-	std::cout << "core num: " << cores << std::endl;
-
-	float rect_width = 100;
-	float rect_height = 100;
-	for (float x = 0; x < static_cast<float>(task.cfg.width) / rect_width; ++x) {
-		for (float y = 0; y < static_cast<float>(task.cfg.height) / rect_height; ++y) {
-			glm::ivec4 rect(x * rect_width, y * rect_height, 0, 0);
-			rect.z = glm::min(static_cast<float>(task.cfg.width), rect.x + rect_width);
-			rect.w = glm::min(static_cast<float>(task.cfg.height), rect.y + rect_height);
-			task.rectangles.push(rect);
+// captures a g-buffer or relights one, the image either way comes out of relight
+static int render_deferred(const Options &options, const Scene &scene, const Camera &cam) {
+	GBuffer gbuffer;
+	if (!options.capture_path.empty()) {
+		Stats stats;
+		auto start = std::chrono::high_resolution_clock::now();
+		capture_gbuffer(scene, cam, options.cfg, gbuffer, stats);
+		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "capture: " << duration << "ms, " << stats.ray_count << " rays, " << gbuffer.samples.size()
+				  << " samples, " << gbuffer.light_samples.size() << " light samples" << std::endl;
+
+		if (!save_gbuffer(options.capture_path, gbuffer)) {
+			std::cerr << "failed to write g-buffer " << options.capture_path << std::endl;
+			return 1;
 		}
+	} else if (!load_gbuffer(options.relight_path, gbuffer)) {
+		std::cerr << "cannot read g-buffer " << options.relight_path << std::endl;
+		return 1;
 	}
 
-	std::vector<std::thread> threads;
+	const auto &cfg = gbuffer.cfg;
+	std::vector<glm::vec3> colors;
+	std::string error;
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!relight(gbuffer, scene, render_thread_count(options.cfg), colors, error)) {
+		std::cerr << "cannot relight: " << error << std::endl;
+		return 1;
+	}
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::high_resolution_clock::now() - start).count();
+	std::cout << "relight: " << duration << "ms" << std::endl;
+
+	std::vector<char> pixels(cfg.width * cfg.height * 3);
+	tone_map(colors.data(), static_cast<int>(colors.size()), pixels.data());
+	stbi_write_bmp(options.output.c_str(), cfg.width, cfg.height, 3, pixels.data());
+	return 0;
+}
+
+static int bake(const Options &options, const Scene &scene) {
+	Lightmaps lightmaps;
+	Stats stats;
+	auto start = std::chrono::high_resolution_clock::now();
+	bake_lightmaps(scene, options.cfg, options.lightmap_texel, lightmaps, stats);
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::high_resolution_clock::now() - start).count();
+
+	auto planes = std::ranges::count_if(lightmaps.planes, [](const PlaneLightmap &map) { return map.width > 0; });
+	std::cout << "bake: " << duration << "ms, " << stats.ray_count << " rays, " << planes << "/"
+			  << lightmaps.planes.size() << " planes, " << lightmaps.texels.size() << " texels" << std::endl;
+	if (options.print_stats) print_stats(std::cout, stats);
+
+	if (!save_lightmaps(options.bake_path, lightmaps)) {
+		std::cerr << "failed to write lightmaps " << options.bake_path << std::endl;
+		return 1;
+	}
+	return 0;
+}
 
-	for (auto i = 0; i < cores; ++i) {
-		std::thread t([&task]() { generate_image_part(task); });
-		threads.emplace_back(std::move(t));
+static int autotune(const Options &options, const SceneEntry &entry, const std::string &tuning_path) {
+	auto profile = run_autotune(entry, options.cfg, *options.autotune, std::cout);
+	if (!save_tuning_profile(tuning_path, profile)) {
+		std::cerr << "failed to write tuning profile " << tuning_path << std::endl;
+		return 1;
 	}
 
-	for (auto &t : threads) t.join();
+	std::cout << "tile size: " << profile.tile_size << ", threads: " << profile.threads << std::endl;
+	if (profile.has_sample_split) {
+		std::cout << "samples: " << profile.samples_base << ", ao: " << profile.ambient_occlusion_samples
+				  << ", area light samples: " << profile.area_light_samples << std::endl;
+	}
+	std::cout << "tuning profile: " << tuning_path << std::endl;
+	return 0;
 }
 
-int main() {
-	auto cfg = Config{};
+int main(int argc, char **argv) {
+	Options options;
+	if (!parse_args(argc, argv, options)) {
+		print_usage();
+		return 1;
+	}
+	const auto &cfg = options.cfg;
 
-	auto cam = Camera{
-			.position = {0, 5, -16},
-			.look_at = {0, 5, 0}, // forward: 0 0 1
+	// stdout carries the tile stream, nothing may be printed ahead of it
+	if (options.worker) return run_render_worker(STDIN_FILENO, STDOUT_FILENO);
+	if (!options.socket_path.empty()) return run_render_server(options.socket_path, cfg);
+	if (options.distributed) return render_distributed(options);
 
-			.vfov = 50.0,
-			.focal_length = 1.f,
-	};
-	init_camera(cam, cfg.width, cfg.height);
+	if (!options.trace_path.empty()) {
+		trace_enable();
+		trace_thread_name("main");
+	}
+
+	auto entry = find_scene(options.scene);
+	if (!entry) {
+		std::cerr << "unknown scene: " << options.scene << std::endl;
+		return 1;
+	}
+
+	auto tuning_path = options.tuning_path.empty() ? default_tuning_path(options.scene) : options.tuning_path;
+	if (options.autotune) return autotune(options, *entry, tuning_path);
 
 	Scene scene;
+	{
+		TRACE_SCOPE("scene setup", "setup");
+		entry->make_scene(scene);
+	}
+	if (options.translate.first != NULL_ENTITY)
+		translate_entities(scene, options.translate.first, options.translate.last, options.translate.offset);
+	if (!apply_edits(options, scene)) {
+		std::cerr << "edit refers to an unknown entity, light or material type" << std::endl;
+		return 1;
+	}
+	if (options.print_entities) {
+		print_entities(scene);
+		return 0;
+	}
 
-	// floor
-	add_plane(scene, make_mat_lambert({1, 1, 1}), make_rect(
-			{0, 0, 0},
-			{0, 1, 0},
-			{1, 0, 0},
-			{10, 10}
-	));
-	// back
-	add_plane(scene, make_mat_lambert({1, 1, 1}), make_rect(
-			{0, 5, 5},
-			{0, 0, -1},
-			{1, 0, 0},
-			{10, 10}
-	));
-	// ceiling
-	add_plane(scene, make_mat_lambert({1, 1, 1}), make_rect(
-			{0, 10, 0},
-			{0, -1, 0},
-			{-1, 0, 0},
-			{10, 10}
-	));
-	// left
-	add_plane(scene, make_mat_lambert({1, 0, 0}), make_rect(
-			{-5, 5, 0},
-			{1, 0, 0},
-			{0, -1, 0},
-			{10, 10}
-	));
-	// right
-	add_plane(scene, make_mat_lambert({0, 1, 0}), make_rect(
-			{5, 5, 0},
-			{-1, 0, 0},
-			{0, 1, 0},
-			{10, 10}
-	));
-
-	auto box_material = Material{
-			.type = MaterialType::kBlinnPhong,
-			.color = {1, 1, 1},
-			.blinnPhong = {
-					.diffuse_intensity = 1.f,
-					.specular_intensity = 1.f,
-			},
-	};
-	// left
-	add_planes(scene, box_material, make_box(
-			{-2, 3, 2},
-			{3, 6, 3},
-			glm::rotate(glm::mat4(1.f), glm::radians(-25.f), {0, 1, 0})
-	));
-	// right
-	add_planes(scene, box_material, make_box(
-			{1.5, 1.5, -2},
-			{3, 3, 3},
-			glm::rotate(glm::mat4(1.f), glm::radians(20.f), {0, 1, 0})
-	));
-
-	// light
-	auto area_light = AreaLight{
-			.color = {1, 1, 1},
-			.intensity = 1.f,
-			.u_samples = 3,
-			.v_samples = 3,
-			.max_random_offset = .3f,
-	};
-	add_area_light(scene, area_light, make_rect(
-			{0, 9.9999f, 0},
-			{0, -1, 0},
-			{0, 0, 1},
-			{1, 1}
-	));
+	TuningProfile profile;
+	if (options.use_tuning && load_tuning_profile(tuning_path, profile)) {
+		std::string reason;
+		if (tuning_matches(profile, options.cfg, reason)) {
+			apply_tuning_profile(profile, options.cfg, scene);
+			// options given on the command line still win over the profile
+			parse_args(argc, argv, options);
+			std::cout << "tuning profile: " << tuning_path << std::endl;
+		} else {
+			std::cout << "ignoring tuning profile " << tuning_path << ": " << reason << std::endl;
+		}
+	}
+
+	if (!options.bake_path.empty()) return bake(options, scene);
+
+	Lightmaps lightmaps;
+	if (!options.lightmap_path.empty()) {
+		if (!load_lightmaps(options.lightmap_path, lightmaps)) {
+			std::cerr << "cannot read lightmaps " << options.lightmap_path << std::endl;
+			return 1;
+		}
+		if (!lightmaps_match(lightmaps, scene)) {
+			std::cerr << "lightmaps " << options.lightmap_path << " were baked for a different scene" << std::endl;
+			return 1;
+		}
+	}
+
+	auto cam = entry->make_camera();
+	init_camera(cam, cfg.width, cfg.height);
+	if (!options.capture_path.empty() || !options.relight_path.empty()) return render_deferred(options, scene, cam);
 
 	auto bmp_size = cfg.width * cfg.height * 3;
 	auto pixel_buffer = new char[bmp_size];
 	memset(pixel_buffer, 0, bmp_size);
 
+	std::vector<PixelCost> pixel_costs;
+	if (!options.heatmap_prefix.empty()) pixel_costs.resize(cfg.width * cfg.height);
+
+	std::vector<glm::vec3> colors;
+	if (!options.checkpoint_path.empty() || !options.cache_dir.empty() || !options.incremental_path.empty())
+		colors.resize(cfg.width * cfg.height);
+
+	std::optional<RenderCache> cache;
+	if (!options.cache_dir.empty())
+		cache.emplace(options.cache_dir, static_cast<std::uint64_t>(options.cache_size_mb) << 20);
+
 	RenderingTask task{
 			.cfg = cfg,
 			.cam = cam,
 			.scene = scene,
 
 			.pixel_buffer = pixel_buffer,
+			.pixel_costs = pixel_costs.empty() ? nullptr : pixel_costs.data(),
+			.color_buffer = colors.empty() ? nullptr : colors.data(),
+
+			.cache = cache ? &*cache : nullptr,
+
+			.context = {.lightmaps = options.lightmap_path.empty() ? nullptr : &lightmaps},
+
+			.record_entities = !options.incremental_path.empty(),
+
+			.perf_counters = options.perf_counters,
 	};
 
+	if (options.resume) {
+		std::string error;
+		if (!load_checkpoint(options.checkpoint_path, task, error)) {
+			std::cerr << "cannot resume: " << error << std::endl;
+			return 1;
+		}
+		auto done = std::count(task.tiles_done.begin(), task.tiles_done.end(), true);
+		std::cout << "resuming: " << done << "/" << task.tiles_done.size() << " tiles done" << std::endl;
+	}
+
+	auto frame_lightmaps = options.lightmap_path.empty() ? 0 : lightmaps_hash(lightmaps);
+	FrameRecord previous;
+	if (!options.incremental_path.empty() && !options.resume && load_frame_record(options.incremental_path, previous)) {
+		auto invalidation = invalidate_tiles(previous, scene, cam, cfg, frame_lightmaps);
+		if (invalidation.full) {
+			std::cout << "incremental: full render, " << invalidation.reason << std::endl;
+		} else {
+			auto dirty = std::count(invalidation.tiles.begin(), invalidation.tiles.end(), true);
+			std::cout << "incremental: " << invalidation.changed_entities.size() << " changed entities, rendering "
+					  << dirty << "/" << invalidation.tiles.size() << " tiles" << std::endl;
+
+			task.tiles_done.assign(invalidation.tiles.size(), false);
+			for (auto i = 0; i < invalidation.tiles.size(); ++i) task.tiles_done[i] = !invalidation.tiles[i];
+			task.tile_entities = std::move(previous.tile_entities);
+			std::copy(previous.colors.begin(), previous.colors.end(), colors.begin());
+			tone_map(colors.data(), static_cast<int>(colors.size()), pixel_buffer);
+		}
+	}
+
+	std::optional<CheckpointWriter> checkpoint;
+	if (!options.checkpoint_path.empty()) {
+		checkpoint.emplace(options.checkpoint_path, task, std::chrono::seconds(options.checkpoint_interval_s));
+		task.on_tile_done = [&checkpoint](const glm::ivec4 &rect) { checkpoint->tile_done(rect); };
+	}
+
+	std::cout << "core num: " << render_thread_count(cfg) << std::endl;
+	std::cout << "kernel isa: " << kernel_isa() << std::endl;
+
 	auto start = std::chrono::high_resolution_clock::now();
+	if (options.deadline_ms > 0)
+		task.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.deadline_ms);
 	generate_image(task);
+	checkpoint.reset();
 	auto finish = std::chrono::high_resolution_clock::now();
 	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
 	std::cout << duration << "ms - " << (duration / 1000.f / 60.f) << "m" << std::endl;
 	std::cout << "rays: " << task.stats.ray_count << std::endl;
+	if (options.deadline_ms > 0) {
+		auto filled = std::count(task.tiles_filled.begin(), task.tiles_filled.end(), true);
+		std::cout << "filled after deadline: " << filled << "/" << task.tiles_filled.size() << " tiles" << std::endl;
+	}
+	if (options.print_stats) print_stats(std::cout, task.stats);
+	if (cache) print_cache_report(std::cout, cache->report());
+
+	if (!options.incremental_path.empty()) {
+		auto record = FrameRecord{
+				.scene = scene,
+				.cam = cam,
+				.cfg = cfg,
+				.lightmaps = frame_lightmaps,
+				.tile_entities = std::move(task.tile_entities),
+				.tiles_filled = task.tiles_filled,
+				.colors = colors,
+		};
+		if (!save_frame_record(options.incremental_path, record))
+			std::cerr << "failed to write frame record " << options.incremental_path << std::endl;
+	}
+
+	if (options.perf_counters) {
+		if (!task.perf_error.empty()) std::cout << "perf counters unavailable: " << task.perf_error << std::endl;
 
-	stbi_write_bmp("test.bmp", cfg.width, cfg.height, 3, pixel_buffer);
+		std::vector<std::uint64_t> thread_rays;
+		for (const auto &times : task.thread_times) thread_rays.push_back(times.rays);
+		print_perf_counts(std::cout, task.thread_perf, thread_rays);
+	}
+
+	{
+		TRACE_SCOPE("image encode", "output");
+		stbi_write_bmp(options.output.c_str(), cfg.width, cfg.height, 3, pixel_buffer);
+	}
 	delete[] pixel_buffer;
 
+	if (!pixel_costs.empty()) {
+		std::vector<float> values(pixel_costs.size());
+		std::vector<char> heat(pixel_costs.size() * 3);
+
+		for (auto i = 0; i < values.size(); ++i) values[i] = static_cast<float>(pixel_costs[i].rays);
+		heatmap(values.data(), static_cast<int>(values.size()), heat.data());
+		stbi_write_bmp((options.heatmap_prefix + "_rays.bmp").c_str(), cfg.width, cfg.height, 3, heat.data());
+
+		for (auto i = 0; i < values.size(); ++i) values[i] = pixel_costs[i].time_us;
+		heatmap(values.data(), static_cast<int>(values.size()), heat.data());
+		stbi_write_bmp((options.heatmap_prefix + "_time.bmp").c_str(), cfg.width, cfg.height, 3, heat.data());
+	}
+
+	if (!options.trace_path.empty()) {
+		if (!trace_write(options.trace_path)) {
+			std::cerr << "failed to write trace to " << options.trace_path << std::endl;
+			return 1;
+		}
+		std::cout << "trace: " << options.trace_path << std::endl;
+	}
+
 	return 0;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <random>
 #include <glm/common.hpp>
 #include <glm/trigonometric.hpp>
@@ -15,10 +16,16 @@ static inline float deg2rad(float d) {
 	return d * PI / 180.0;
 }
 
+// every thread samples from its own generator, render_tile reseeds it for each tile
+inline thread_local std::mt19937 random_generator;
+
+static inline void seed_random(std::uint32_t seed) {
+	random_generator.seed(seed);
+}
+
+// the distribution is built per call, a static one would keep the range of whichever call came first
 static inline float rand_float(float min, float max) {
-	static std::uniform_real_distribution<float> d(min, max);
-	static std::mt19937 g;
-	return d(g);
+	return std::uniform_real_distribution<float>(min, max)(random_generator);
 }
 
 static inline float rand_float() {
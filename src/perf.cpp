@@ -0,0 +1,163 @@
+#include "perf.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static perf_event_attr event_attr(PerfEvent event) {
+	perf_event_attr attr{};
+	attr.size = sizeof(attr);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	switch (event) {
+	case PerfEvent::kCycles:
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CPU_CYCLES;
+		break;
+	case PerfEvent::kInstructions:
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+		break;
+	case PerfEvent::kL1dMisses:
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_L1D |
+					  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+					  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		break;
+	case PerfEvent::kLlcMisses:
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		break;
+	case PerfEvent::kBranchMisses:
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+		break;
+	case PerfEvent::kCount:
+		break;
+	}
+	return attr;
+}
+
+PerfCounters::PerfCounters() {
+	for (auto i = 0; i < kPerfEventCount; ++i) {
+		auto attr = event_attr(static_cast<PerfEvent>(i));
+		fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+		if (fds[i] < 0 && error.empty()) error = strerror(errno);
+	}
+}
+
+PerfCounters::~PerfCounters() {
+	for (auto fd : fds)
+		if (fd >= 0) close(fd);
+}
+
+void PerfCounters::start() {
+	for (auto fd : fds) {
+		if (fd < 0) continue;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void PerfCounters::stop() {
+	for (auto fd : fds)
+		if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+}
+
+PerfCounts PerfCounters::read() const {
+	PerfCounts counts;
+	for (auto i = 0; i < kPerfEventCount; ++i) {
+		if (fds[i] < 0) continue;
+
+		std::uint64_t data[3]; // value, time enabled, time running
+		if (::read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+
+		auto scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+		counts.values[i] = static_cast<std::uint64_t>(static_cast<double>(data[0]) * scale);
+		counts.valid[i] = true;
+	}
+	return counts;
+}
+
+#else
+
+PerfCounters::PerfCounters() : error("perf_event_open is only available on linux") {
+	fds.fill(-1);
+}
+
+PerfCounters::~PerfCounters() = default;
+
+void PerfCounters::start() {}
+
+void PerfCounters::stop() {}
+
+PerfCounts PerfCounters::read() const {
+	return {};
+}
+
+#endif
+
+void PerfCounts::merge(const PerfCounts &other) {
+	for (auto i = 0; i < kPerfEventCount; ++i) {
+		values[i] += other.values[i];
+		valid[i] = valid[i] || other.valid[i];
+	}
+}
+
+static void print_row(std::ostream &out, const std::string &name, const PerfCounts &counts, std::uint64_t rays) {
+	auto value = [&counts](PerfEvent e) { return counts.values[static_cast<std::size_t>(e)]; };
+	auto valid = [&counts](PerfEvent e) { return counts.valid[static_cast<std::size_t>(e)]; };
+	auto per_ray = [rays](std::uint64_t v) {
+		return rays > 0 ? static_cast<double>(v) / static_cast<double>(rays) : 0.0;
+	};
+
+	out << std::setw(8) << name;
+	for (auto i = 0; i < kPerfEventCount; ++i) {
+		out << "  " << std::setw(14);
+		if (counts.valid[i]) out << counts.values[i];
+		else out << "-";
+	}
+
+	out << std::fixed << std::setprecision(2);
+	out << "  " << std::setw(5);
+	if (valid(PerfEvent::kCycles) && valid(PerfEvent::kInstructions) && value(PerfEvent::kCycles) > 0)
+		out << static_cast<double>(value(PerfEvent::kInstructions)) / static_cast<double>(value(PerfEvent::kCycles));
+	else out << "-";
+
+	out << "  " << std::setw(10);
+	if (valid(PerfEvent::kCycles)) out << per_ray(value(PerfEvent::kCycles));
+	else out << "-";
+
+	out << "  " << std::setw(10);
+	if (valid(PerfEvent::kLlcMisses)) out << per_ray(value(PerfEvent::kLlcMisses));
+	else out << "-";
+
+	out.unsetf(std::ios::floatfield);
+	out << std::endl;
+}
+
+void print_perf_counts(std::ostream &out, const std::vector<PerfCounts> &threads,
+					   const std::vector<std::uint64_t> &thread_rays) {
+	out << "  thread          cycles    instructions      l1d misses      llc misses   branch misses"
+		<< "    ipc  cycles/ray     llc/ray" << std::endl;
+
+	PerfCounts total;
+	std::uint64_t total_rays = 0;
+	for (auto i = 0; i < threads.size(); ++i) {
+		auto rays = i < thread_rays.size() ? thread_rays[i] : 0;
+		print_row(out, std::to_string(i), threads[i], rays);
+		total.merge(threads[i]);
+		total_rays += rays;
+	}
+	print_row(out, "total", total, total_rays);
+}
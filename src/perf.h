@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// hardware counters read through linux perf_event_open, counting user space of the calling thread only
+enum class PerfEvent {
+	kCycles = 0,
+	kInstructions,
+	kL1dMisses,
+	kLlcMisses,
+	kBranchMisses,
+	kCount,
+};
+
+static constexpr auto kPerfEventCount = static_cast<std::size_t>(PerfEvent::kCount);
+
+struct PerfCounts {
+	std::array<std::uint64_t, kPerfEventCount> values{};
+	std::array<bool, kPerfEventCount> valid{};
+
+	void merge(const PerfCounts &other);
+};
+
+// counters of the thread that opened them, events the host or kernel does not allow stay invalid
+struct PerfCounters {
+	std::array<int, kPerfEventCount> fds;
+	std::string error; // why the first unavailable event could not be opened
+
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters &) = delete;
+	PerfCounters &operator=(const PerfCounters &) = delete;
+
+	void start();
+	void stop();
+	// scaled by enabled / running time when the kernel had to multiplex the counters
+	PerfCounts read() const;
+};
+
+// per thread and total counters, ipc and the per ray metrics derived from the ray counts
+void print_perf_counts(std::ostream &out, const std::vector<PerfCounts> &threads,
+					   const std::vector<std::uint64_t> &thread_rays);
@@ -1,15 +1,36 @@
 #include "ray.h"
 
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <utility>
 #include <glm/glm.hpp>
 
 #include "camera.h"
 #include "config.h"
+#include "context.h"
+#include "ao_cache.h"
+#include "cpu.h"
+#include "guiding.h"
+#include "irradiance_cache.h"
+#include "lightmap.h"
 #include "math.h"
+#include "reservoir.h"
 #include "scene.h"
 
-inline Ray secondary_ray(const glm::vec3 &origin, const glm::vec3 &direction) {
-	return Ray{.origin = origin + direction * EPSILON, .direction = direction};
-}
+static constexpr int kDynamicSamples = -1;
+
+// scene and config features a ray_color kernel is specialized for
+struct KernelFeatures {
+	bool directional_lights = true;
+	bool area_lights = true;
+	bool indirect = true;
+
+	bool unlit = true;
+	bool blinn_phong = true;
+
+	int ambient_occlusion_samples = kDynamicSamples;
+};
 
 glm::vec3 blinn_phong(const HitRecord &hit, const Camera &camera, const glm::vec3 &to_light) {
 	auto mat = hit.material->blinnPhong;
@@ -30,112 +51,467 @@ glm::vec3 blinn_phong(const HitRecord &hit, const Camera &camera, const glm::vec
 	return (diffuse + specular) * hit.material->color;
 }
 
+template<KernelFeatures F>
 glm::vec3 calc_surface_color(const HitRecord &hit, const Camera &camera, const glm::vec3 &to_light) {
-	switch (hit.material->type) {
-	default:
+	// unlit hits return before shading, so blinn phong is the only remaining material type
+	if constexpr (F.blinn_phong)
+		return blinn_phong(hit, camera, to_light);
+	else
 		return {0, 0, 0};
+}
 
-	case MaterialType::kBlinnPhong:
-		return blinn_phong(hit, camera, to_light);
+template<KernelFeatures F>
+float ambient_occlusion(const HitRecord &hit, const Scene &scene, const Config &cfg, const RenderContext &context,
+						Stats &stats, int bounce) {
+	auto samples = F.ambient_occlusion_samples == kDynamicSamples ? cfg.ambient_occlusion_samples
+																	: F.ambient_occlusion_samples;
+	auto occlusions = 0.f;
+
+	float cached;
+	if (context.ao_cache) {
+		++stats.ao_cache_lookups;
+		if (context.ao_cache->lookup(hit.position, hit.normal, cached)) {
+			++stats.ao_cache_hits;
+			return cached;
+		}
+	}
+	stats.ao_rays[bounce] += samples;
+
+	for (auto i = 0; i < samples; ++i) {
+		auto dir = uniform_sample_hemisphere(rand_float(), rand_float());
+		dir = glm::normalize(align_tbn(dir, hit.normal, hit.tangent));
+
+		auto ambient_ray = secondary_ray(hit.position, dir);
+		auto ambient_hit = hit_scene(ambient_ray, scene, context, stats);
+		if (ambient_hit) {
+			++stats.ao_hits[bounce];
+			auto dst = glm::min(ambient_hit->distance / 4.f, 1.f);
+			occlusions += 1.f - dst;
+		}
 	}
+
+	if (context.ao_cache) return context.ao_cache->add(hit.position, hit.normal, occlusions, samples);
+	return occlusions / static_cast<float>(samples);
 }
 
+template<KernelFeatures F>
+glm::vec3 cached_irradiance(const HitRecord &hit, const Camera &camera, const Scene &scene, const Config &cfg,
+							const RenderContext &context, Stats &stats, int max_depth, const glm::vec3 &direct);
+
+template<KernelFeatures F>
+glm::vec3 shade_surface(const HitRecord &hit, const Camera &camera, const Scene &scene, const Config &cfg,
+						const RenderContext &context, Stats &stats, int max_depth);
+
+template<KernelFeatures F>
+glm::vec3 hit_color(const Ray &ray, const Hit &closest, const Camera &camera, const Scene &scene, const Config &cfg,
+					const RenderContext &context, Stats &stats, int max_depth);
+
+template<KernelFeatures F>
+ISA_KERNEL
 glm::vec3 ray_color(const Ray &ray, const Camera &camera, const Scene &scene, const Config &cfg,
-					Stats &stats, int max_depth) {
+					const RenderContext &context, Stats &stats, int max_depth) {
 	if (max_depth <= 0)
 		return glm::vec3(0);
 
-	auto hit = hit_scene(ray, scene, stats);
-	if (!hit || !hit->front_facing) return glm::vec3(0);
+	auto bounce = glm::clamp(cfg.max_depth - max_depth, 0, kStatsMaxBounces - 1);
 
-	if (hit->material->type == MaterialType::kUnlit)
-		return hit->material->color;
+	auto closest = hit_scene(ray, scene, context, stats);
+	if (!closest) {
+		++stats.path_length[bounce + 1];
+		return glm::vec3(0);
+	}
+	return hit_color<F>(ray, *closest, camera, scene, cfg, context, stats, max_depth);
+}
 
-	glm::vec3 direct_color(0.f);
-	glm::vec3 indirect_color(0.f);
+// ray_color of ray once it is known to end at closest
+template<KernelFeatures F>
+glm::vec3 hit_color(const Ray &ray, const Hit &closest, const Camera &camera, const Scene &scene, const Config &cfg,
+					const RenderContext &context, Stats &stats, int max_depth) {
+	auto bounce = glm::clamp(cfg.max_depth - max_depth, 0, kStatsMaxBounces - 1);
 
-	// directional lights
-	for (const auto &l : scene.directional_lights) {
-		auto light_ray = secondary_ray(hit->position, -l.direction);
-		auto light_hit = hit_scene(light_ray, scene, stats);
-		if (light_hit) continue;
+	auto hit = surface_attributes(ray, scene, closest);
+	if (!hit.front_facing) {
+		++stats.path_length[bounce + 1];
+		return glm::vec3(0);
+	}
+
+	if constexpr (F.unlit) {
+		if (hit.material->type == MaterialType::kUnlit) {
+			++stats.path_length[bounce + 1];
+			return hit.material->color;
+		}
+	}
 
-		auto surface_color = calc_surface_color(hit.value(), camera, -l.direction);
-		direct_color += l.intensity * l.color * surface_color;
+	glm::vec3 light;
+	if (context.lightmaps && closest.kind == PrimitiveKind::kPlane &&
+		sample_lightmap(*context.lightmaps, scene, closest.index, hit.position, light)) {
+		++stats.lightmap_hits;
+		++stats.path_length[bounce + 1];
+		return glm::clamp(hit.material->color * light, 0.f, 1.f);
+	}
+
+	return shade_surface<F>(hit, camera, scene, cfg, context, stats, max_depth);
+}
+
+// calls visit(light, to_light) for the light samples at hit that are not in shadow, see visible_light_samples
+template<KernelFeatures F, typename Visit>
+void for_visible_light_samples(const HitRecord &hit, const Scene &scene, const RenderContext &context, Stats &stats,
+							   int bounce, Visit &&visit) {
+	// directional lights
+	if constexpr (F.directional_lights) {
+		for (auto i = 0; i < scene.directional_lights.size(); ++i) {
+			auto to_light = -scene.directional_lights[i].direction;
+			auto light_ray = secondary_ray(hit.position, to_light);
+			auto light_hit = hit_scene(light_ray, scene, context, stats);
+			++stats.shadow_rays[bounce];
+			if (light_hit) {
+				++stats.shadow_hits[bounce];
+				continue;
+			}
+			visit(i, to_light);
+		}
 	}
 
 	// area lights
-	for (auto i = 0; i < scene.area_lights.size(); ++i) {
-		const auto &plane = scene.area_lights[i];
-		const auto &data = scene.area_light_data[i];
-		const auto mro = data.max_random_offset;
+	if constexpr (F.area_lights) {
+		auto directional = static_cast<int>(scene.directional_lights.size());
+		for (auto i = 0; i < scene.area_lights.size(); ++i) {
+			const auto &plane = scene.area_lights[i];
+			const auto &data = scene.area_light_data[i];
+			const auto mro = data.max_random_offset;
+
+			auto u_size = plane.width / static_cast<float>(data.u_samples);
+			auto v_size = plane.height / static_cast<float>(data.v_samples);
+			auto corner =
+					plane.position - plane.bi_tangent * (plane.width * .5f) - plane.tangent * (plane.height * .5f);
+
+			for (auto u = 0; u < data.u_samples; ++u) {
+				for (auto v = 0; v < data.v_samples; ++v) {
+					glm::vec2 offset = {
+							(u + .5f + rand_float(-mro, mro)) * u_size,
+							(v + .5f + rand_float(-mro, mro)) * v_size,
+					};
+					auto pos = corner + plane.bi_tangent * offset.x + plane.tangent * offset.y;
+					auto dir = glm::normalize(pos - hit.position);
+
+					// ignore every object above the light
+					if (glm::dot(dir, plane.normal) > 0) continue;
+
+					auto light_ray = secondary_ray(hit.position, dir);
+					auto light_hit = hit_scene(light_ray, scene, context, stats);
+					++stats.shadow_rays[bounce];
+
+					// only calculate light if ray intersects with the area light first
+					if (light_hit && hit_entity(scene, light_hit.value()) != plane.id) {
+						++stats.shadow_hits[bounce];
+						continue;
+					}
+					visit(directional + i, dir);
+				}
+			}
+		}
+	}
+}
 
-		auto u_size = plane.width / static_cast<float>(data.u_samples);
-		auto v_size = plane.height / static_cast<float>(data.v_samples);
-		auto corner = plane.position - plane.bi_tangent * (plane.width * .5f) - plane.tangent * (plane.height * .5f);
+glm::vec3 light_sample_radiance(const Scene &scene, int light) {
+	auto directional = static_cast<int>(scene.directional_lights.size());
+	if (light < directional) return scene.directional_lights[light].intensity * scene.directional_lights[light].color;
 
-		glm::vec3 area_color = {0, 0, 0};
+	const auto &data = scene.area_light_data[light - directional];
+	return data.color * data.intensity / static_cast<float>(data.u_samples * data.v_samples);
+}
 
-		for (auto u = 0; u < data.u_samples; ++u) {
-			for (auto v = 0; v < data.v_samples; ++v) {
-				glm::vec2 offset = {
-						(u + .5f + rand_float(-mro, mro)) * u_size,
-						(v + .5f + rand_float(-mro, mro)) * v_size,
-				};
-				auto pos = corner + plane.bi_tangent * offset.x + plane.tangent * offset.y;
-				auto dir = glm::normalize(pos - hit->position);
+// light from every light at hit, with shadows
+template<KernelFeatures F>
+glm::vec3 direct_light(const HitRecord &hit, const Camera &camera, const Scene &scene, const RenderContext &context,
+					   Stats &stats, int bounce) {
+	glm::vec3 direct_color(0.f);
+	if constexpr (F.blinn_phong) {
+		for_visible_light_samples<F>(hit, scene, context, stats, bounce, [&](int light, const glm::vec3 &to_light) {
+			direct_color += light_sample_radiance(scene, light) * calc_surface_color<F>(hit, camera, to_light);
+		});
+	}
+	return direct_color;
+}
 
-				// ignore every object above the light
-				if (glm::dot(dir, plane.normal) > 0) continue;
+// light leaving a lit hit, clamped per bounce
+template<KernelFeatures F>
+ISA_KERNEL
+glm::vec3 shade_surface(const HitRecord &hit, const Camera &camera, const Scene &scene, const Config &cfg,
+						const RenderContext &context, Stats &stats, int max_depth) {
+	auto bounce = glm::clamp(cfg.max_depth - max_depth, 0, kStatsMaxBounces - 1);
 
-				auto light_ray = secondary_ray(hit->position, dir);
-				auto light_hit = hit_scene(light_ray, scene, stats);
+	glm::vec3 direct_color(0.f);
+	glm::vec3 indirect_color(0.f);
 
-				// only calculate light if ray intersects with the area light first
-				if (light_hit && light_hit->entity_id != plane.id) continue;
+	// the camera hit of a pixel that resamples its lights only traces the sample its reservoir kept
+	if (context.light_reservoir && bounce == 0)
+		direct_color = resampled_direct_light(hit, camera, scene, *context.light_reservoir, context, stats, bounce);
+	else
+		direct_color = direct_light<F>(hit, camera, scene, context, stats, bounce);
 
-				area_color += calc_surface_color(hit.value(), camera, dir);
+	// indirect diffuse lighting
+	auto path_ends = true;
+	auto cached = false;
+	auto guided_ratio = 1.f;
+	std::optional<glm::vec3> bounce_direction;
+	if constexpr (F.indirect) {
+		if (max_depth > 1 && context.irradiance_cache && bounce == 0) {
+			path_ends = false;
+			cached = true;
+		} else if (max_depth > 1) {
+			path_ends = false;
+			auto dir = uniform_sample_hemisphere(rand_float(), rand_float());
+			dir = align_tbn(dir, hit.normal, hit.tangent);
+			dir = glm::normalize(dir);
+
+			// the first bounce samples a one sample mix of the guide and the hemisphere, guided_ratio is the hemisphere
+			// pdf over the mixed one. deeper bounces only record for the guide, see the end of the function. where the
+			// guide learned nothing yet it would spend half its samples below the surface, the hemisphere is kept
+			const auto *guide_cell = context.guiding && bounce == 0
+									 ? &context.guiding->distribution(hit.position, hit.normal) : nullptr;
+			if (guide_cell && !guide_cell->empty()) {
+				const auto &guide = *guide_cell;
+				auto guide_pdf = 0.f;
+				if (rand_float() < kGuidingFraction) dir = guide.sample(rand_float(), rand_float(), guide_pdf);
+				else guide_pdf = guide.pdf(dir);
+
+				auto hemisphere_pdf = glm::max(0.f, glm::dot(hit.normal, dir)) / PI;
+				auto pdf = kGuidingFraction * guide_pdf + (1.f - kGuidingFraction) * hemisphere_pdf;
+				guided_ratio = pdf > 0.f ? hemisphere_pdf / pdf : 0.f;
+			}
+
+			if (guided_ratio > 0.f) {
+				auto indirect_ray = secondary_ray(hit.position, dir);
+				auto indirect = ray_color<F>(indirect_ray, camera, scene, cfg, context, stats, max_depth - 1);
+				auto cos0 = glm::max(0.f, glm::dot(hit.normal, dir));
+
+				static const float p = 1.f / (2.f * PI);
+				indirect_color += (hit.material->color / PI) * indirect * cos0 / p;
+
+				bounce_direction = dir;
 			}
 		}
+	}
+	if (path_ends) ++stats.path_length[bounce + 1];
 
-		area_color *= data.color * data.intensity;
-		area_color /= static_cast<float>(data.u_samples * data.v_samples);
-		direct_color += area_color;
+	// ambient occlusion
+	if constexpr (F.ambient_occlusion_samples != 0) {
+		if (F.ambient_occlusion_samples != kDynamicSamples || cfg.ambient_occlusion_samples > 0)
+			direct_color *= 1.f - ambient_occlusion<F>(hit, scene, cfg, context, stats, bounce);
 	}
 
-	// indirect diffuse lighting
-	if (max_depth > 1) {
-		auto dir = uniform_sample_hemisphere(rand_float(), rand_float());
-		dir = align_tbn(dir, hit->normal, hit->tangent);
-		dir = glm::normalize(dir);
+	// after the occlusion, records hold only what the clamp below lets through over the direct light
+	if (cached) {
+		auto irradiance = cached_irradiance<F>(hit, camera, scene, cfg, context, stats, max_depth, direct_color);
+		indirect_color += (hit.material->color / PI) * irradiance;
+	}
 
-		auto indirect_ray = secondary_ray(hit->position, dir);
-		auto indirect = ray_color(indirect_ray, camera, scene, cfg, stats, max_depth - 1);
-		auto cos0 = glm::max(0.f, glm::dot(hit->normal, dir));
+	auto color = glm::clamp(direct_color + indirect_color, 0.f, 1.f);
+	if (!context.guiding) return color;
+
+	// the clamp makes the mean of a bounce depend on how it was sampled. what the clamped indirect light adds over the
+	// direct light is weighed by the guided ratio instead, which keeps the mean of hemisphere sampling as long as the
+	// bounces further down are sampled from the hemisphere too. that share over the pdf of its direction, times the
+	// hemisphere pdf, is also what the guide learns to sample
+	auto direct = glm::clamp(direct_color, 0.f, 1.f);
+	auto added = (color - direct) * guided_ratio;
+	if (context.record_guiding && bounce_direction)
+		context.guiding->record(hit.position, hit.normal, *bounce_direction, (added.x + added.y + added.z) / 3.f);
+	return direct + added;
+}
 
-		static const float p = 1.f / (2.f * PI);
-		indirect_color += (hit->material->color / PI) * indirect * cos0 / p;
+// samples the hemisphere above hit on a stratified grid for a new record. the indirect estimate ray_color uses weighs
+// radiance by 2 cos over the cosine weighted pdf, so the gradients of ward and heckbert are taken over that weighted
+// radiance. every sample is cut to what a traced path with the direct light of hit would keep of it after the clamp
+template<KernelFeatures F>
+IrradianceRecord sample_irradiance(const HitRecord &hit, const Camera &camera, const Scene &scene, const Config &cfg,
+								   const RenderContext &context, Stats &stats, int max_depth,
+								   const glm::vec3 &direct) {
+	constexpr auto M = kIrradianceStrataTheta;
+	constexpr auto N = kIrradianceStrataPhi;
+	const auto &cache = *context.irradiance_cache;
+	auto bi_tangent = glm::cross(hit.normal, hit.tangent);
+	auto base_direction = [&](float phi) { return hit.tangent * glm::cos(phi) + bi_tangent * glm::sin(phi); };
+
+	std::array<std::array<glm::vec3, N>, M> radiance;
+	std::array<std::array<float, N>, M> distance;
+	std::array<float, M> tan_theta;
+
+	auto record = IrradianceRecord{.position = hit.position, .normal = hit.normal, .irradiance = glm::vec3(0)};
+	auto inverse_distances = 0.f;
+
+	const auto &color = hit.material->color;
+	auto lit = glm::clamp(direct, 0.f, 1.f);
+	auto clamped = [&](const glm::vec3 &weighted) {
+		auto added = glm::clamp(direct + color * weighted, 0.f, 1.f) - lit;
+		auto result = weighted;
+		for (auto c = 0; c < 3; ++c)
+			if (color[c] > 0.f) result[c] = added[c] / color[c];
+		return result;
+	};
+
+	for (auto j = 0; j < M; ++j) {
+		for (auto k = 0; k < N; ++k) {
+			auto u1 = (j + rand_float()) / M;
+			auto u2 = (k + rand_float()) / N;
+			auto dir = glm::normalize(align_tbn(uniform_sample_hemisphere(u1, u2), hit.normal, hit.tangent));
+			auto cos_theta = glm::sqrt(1.f - u1);
+			tan_theta[j] = glm::sqrt(u1) / glm::max(cos_theta, 1e-3f);
+
+			auto ray = secondary_ray(hit.position, dir);
+			auto closest = hit_scene(ray, scene, context, stats);
+			// hits closer than the smallest record would only blow up the gradients
+			distance[j][k] = closest ? glm::max(closest->distance, cache.min_radius) : INFINITY;
+			// shaded from the hit that gave the distance instead of traced again
+			radiance[j][k] = closest ? clamped(hit_color<F>(ray, *closest, camera, scene, cfg, context, stats,
+															 max_depth - 1) * (2.f * cos_theta))
+									 : glm::vec3(0);
+
+			record.irradiance += radiance[j][k];
+			inverse_distances += 1.f / distance[j][k];
+		}
 	}
+	record.irradiance *= PI / (M * N);
+	record.radius = inverse_distances > 0.f ? (M * N) / inverse_distances : cache.max_radius;
+	record.radius = glm::clamp(record.radius, cache.min_radius, cache.max_radius);
 
-	// ambient occlusion
-	if (cfg.ambient_occlusion_samples > 0) {
-		auto occlusions = 0.f;
+	for (auto c = 0; c < 3; ++c) {
+		record.rotation_gradient[c] = glm::vec3(0);
+		record.translation_gradient[c] = glm::vec3(0);
+	}
 
-		for (auto i = 0; i < cfg.ambient_occlusion_samples; ++i) {
-			auto dir = uniform_sample_hemisphere(rand_float(), rand_float());
-			dir = glm::normalize(align_tbn(dir, hit->normal, hit->tangent));
+	for (auto k = 0; k < N; ++k) {
+		auto phi_k = 2.f * PI * (k + .5f) / N;
+		auto phi_edge = 2.f * PI * k / N;
+		auto u_k = base_direction(phi_k);
+		auto v_k = base_direction(phi_k + .5f * PI);
+		auto v_edge = base_direction(phi_edge + .5f * PI);
+		auto previous_k = (k + N - 1) % N;
+
+		glm::vec3 rotation(0), across_theta(0), across_phi(0);
+		for (auto j = 0; j < M; ++j) {
+			rotation -= radiance[j][k] * tan_theta[j];
+
+			auto cos_lower = glm::sqrt(1.f - static_cast<float>(j) / M);
+			auto cos_upper = glm::sqrt(1.f - static_cast<float>(j + 1) / M);
+			auto sin_center = glm::sqrt((j + .5f) / M);
+			auto cos_center = glm::sqrt(1.f - (j + .5f) / M);
+			auto nearest_phi = glm::min(distance[j][k], distance[j][previous_k]);
+			across_phi += (radiance[j][k] - radiance[j][previous_k]) *
+						  (cos_center * (cos_lower - cos_upper) / (sin_center * nearest_phi));
+
+			if (j == 0) continue;
+			auto sin_lower = glm::sqrt(static_cast<float>(j) / M);
+			auto nearest_theta = glm::min(distance[j][k], distance[j - 1][k]);
+			across_theta += (radiance[j][k] - radiance[j - 1][k]) *
+							(sin_lower * cos_lower * cos_lower / nearest_theta);
+		}
 
-			auto ambient_ray = secondary_ray(hit->position, dir);
-			auto ambient_hit = hit_scene(ambient_ray, scene, stats);
-			if (ambient_hit) {
-				auto dst = glm::min(ambient_hit->distance / 4.f, 1.f);
-				occlusions += 1.f - dst;
-			}
+		for (auto c = 0; c < 3; ++c) {
+			record.rotation_gradient[c] += v_k * (rotation[c] * PI / (M * N));
+			record.translation_gradient[c] += u_k * (across_theta[c] * 2.f * PI / N) + v_edge * across_phi[c];
 		}
+	}
 
-		auto ao_factor = occlusions / static_cast<float>(cfg.ambient_occlusion_samples);
-		direct_color *= 1.f - ao_factor;
+	// a record is not trusted further than its gradient takes it away from its own irradiance, and gradients are
+	// capped so that extrapolating over the valid area never changes a channel by more than itself. both keep the
+	// noise of the hemisphere samples from running away
+	for (auto c = 0; c < 3; ++c) {
+		auto translation = glm::length(record.translation_gradient[c]);
+		if (translation > 0.f) record.radius = glm::min(record.radius, record.irradiance[c] / translation);
+	}
+	record.radius = glm::max(record.radius, cache.min_radius);
+	for (auto c = 0; c < 3; ++c) {
+		auto limit = record.irradiance[c] / record.radius;
+		auto translation = glm::length(record.translation_gradient[c]);
+		if (translation > limit) record.translation_gradient[c] *= limit / translation;
+		auto rotation = glm::length(record.rotation_gradient[c]);
+		if (rotation > record.irradiance[c]) record.rotation_gradient[c] *= record.irradiance[c] / rotation;
 	}
+	return record;
+}
+
+template<KernelFeatures F>
+glm::vec3 cached_irradiance(const HitRecord &hit, const Camera &camera, const Scene &scene, const Config &cfg,
+							const RenderContext &context, Stats &stats, int max_depth, const glm::vec3 &direct) {
+	++stats.irradiance_lookups;
+	glm::vec3 irradiance;
+	if (context.irradiance_cache->lookup(hit.position, hit.normal, irradiance)) return irradiance;
+
+	++stats.irradiance_records;
+	auto record = sample_irradiance<F>(hit, camera, scene, cfg, context, stats, max_depth, direct);
+	context.irradiance_cache->insert(record);
+	return record.irradiance;
+}
+
+glm::vec3 ray_color(const Ray &ray, const Camera &camera, const Scene &scene, const Config &cfg,
+					const RenderContext &context, Stats &stats, int max_depth) {
+	return ray_color<KernelFeatures{}>(ray, camera, scene, cfg, context, stats, max_depth);
+}
+
+glm::vec3 hit_color(const Ray &ray, const Hit &closest, const Camera &camera, const Scene &scene, const Config &cfg,
+					const RenderContext &context, Stats &stats, int max_depth) {
+	return hit_color<KernelFeatures{}>(ray, closest, camera, scene, cfg, context, stats, max_depth);
+}
+
+glm::vec3 shade_surface(const HitRecord &hit, const Camera &camera, const Scene &scene, const Config &cfg,
+						const RenderContext &context, Stats &stats, int max_depth) {
+	return shade_surface<KernelFeatures{}>(hit, camera, scene, cfg, context, stats, max_depth);
+}
+
+void visible_light_samples(const HitRecord &hit, const Scene &scene, const RenderContext &context, Stats &stats,
+						   int bounce, const LightSampleFn &visit) {
+	for_visible_light_samples<KernelFeatures{}>(hit, scene, context, stats, bounce, visit);
+}
+
+float sample_ambient_occlusion(const HitRecord &hit, const Scene &scene, const Config &cfg,
+							   const RenderContext &context, Stats &stats, int bounce) {
+	return ambient_occlusion<KernelFeatures{}>(hit, scene, cfg, context, stats, bounce);
+}
+
+// ambient occlusion sample counts that get their own unrolled kernel, everything else uses kDynamicSamples
+static constexpr std::array kFixedAmbientOcclusionSamples = {0, 1, 2, 4, 5, 8};
+static constexpr auto kFeatureFlagCount = 5;
+static constexpr auto kKernelCount = (1 << kFeatureFlagCount) * (kFixedAmbientOcclusionSamples.size() + 1);
+
+static constexpr KernelFeatures kernel_features(std::size_t index) {
+	auto ao_index = index >> kFeatureFlagCount;
+	return KernelFeatures{
+			.directional_lights = (index & 1) != 0,
+			.area_lights = (index & 2) != 0,
+			.indirect = (index & 4) != 0,
+			.unlit = (index & 8) != 0,
+			.blinn_phong = (index & 16) != 0,
+			.ambient_occlusion_samples = ao_index < kFixedAmbientOcclusionSamples.size()
+										 ? kFixedAmbientOcclusionSamples[ao_index] : kDynamicSamples,
+	};
+}
+
+template<std::size_t... I>
+static constexpr std::array<RayColorFn, sizeof...(I)> make_kernels(std::index_sequence<I...>) {
+	return {&ray_color<kernel_features(I)>...};
+}
+
+static constexpr auto kKernels = make_kernels(std::make_index_sequence<kKernelCount>{});
+
+static bool uses_material(const Scene &scene, MaterialType type) {
+	auto is_type = [type](const Material &m) { return m.type == type; };
+	return std::any_of(scene.sphere_materials.begin(), scene.sphere_materials.end(), is_type) ||
+		   std::any_of(scene.plane_materials.begin(), scene.plane_materials.end(), is_type);
+}
+
+RayColorFn select_ray_color(const Scene &scene, const Config &cfg) {
+	std::size_t index = 0;
+	if (!scene.directional_lights.empty()) index |= 1;
+	if (!scene.area_lights.empty()) index |= 2;
+	if (cfg.max_depth > 1) index |= 4;
+	if (uses_material(scene, MaterialType::kUnlit)) index |= 8;
+	if (uses_material(scene, MaterialType::kBlinnPhong)) index |= 16;
+
+	auto samples = std::find(kFixedAmbientOcclusionSamples.begin(), kFixedAmbientOcclusionSamples.end(),
+							 glm::max(cfg.ambient_occlusion_samples, 0));
+	index |= (samples - kFixedAmbientOcclusionSamples.begin()) << kFeatureFlagCount;
 
-	return glm::clamp(direct_color + indirect_color, 0.f, 1.f);
+	return kKernels[index];
 }
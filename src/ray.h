@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include <glm/vec3.hpp>
 
 #include "material.h"
@@ -14,8 +16,47 @@ inline glm::vec3 ray_at(const Ray &ray, float t) {
 	return ray.origin + ray.direction * t;
 }
 
+// offsets the origin along direction so the ray does not hit the surface it starts on
+inline Ray secondary_ray(const glm::vec3 &origin, const glm::vec3 &direction) {
+	return Ray{.origin = origin + direction * EPSILON, .direction = direction};
+}
+
+glm::vec3 blinn_phong(const struct HitRecord &hit, const struct Camera &camera, const glm::vec3 &to_light);
+
 glm::vec3 ray_color(const Ray &ray, const struct Camera &camera, const Scene &scene, const struct Config &cfg,
-					Stats &stats, int max_depth);
+					const struct RenderContext &context, Stats &stats, int max_depth);
+
+// ray_color of ray once hit_scene found closest for it
+glm::vec3 hit_color(const Ray &ray, const Hit &closest, const struct Camera &camera, const Scene &scene,
+					const struct Config &cfg, const struct RenderContext &context, Stats &stats, int max_depth);
+
+using RayColorFn = glm::vec3 (*)(const Ray &ray, const struct Camera &camera, const Scene &scene,
+								 const struct Config &cfg, const struct RenderContext &context, Stats &stats,
+								 int max_depth);
+
+// light leaving hit, a lit surface, clamped to one per bounce unless path guiding reweighs it. lightmaps are baked
+// with it
+glm::vec3 shade_surface(const struct HitRecord &hit, const struct Camera &camera, const Scene &scene,
+						const struct Config &cfg, const struct RenderContext &context, Stats &stats,
+						int max_depth);
+
+// light samples of the direct light at hit. light counts the directional lights first, then the area lights
+using LightSampleFn = std::function<void(int light, const glm::vec3 &to_light)>;
+
+// traces the shadow ray of every light sample shade_surface takes at hit, in its order, and calls visit for the ones
+// that are not in shadow
+void visible_light_samples(const struct HitRecord &hit, const Scene &scene, const struct RenderContext &context,
+						   Stats &stats, int bounce, const LightSampleFn &visit);
+
+// what a visible light sample of light adds per unit of blinn_phong toward it
+glm::vec3 light_sample_radiance(const Scene &scene, int light);
+
+// share of cfg.ambient_occlusion_samples hemisphere rays around hit that are occluded, weighted by distance
+float sample_ambient_occlusion(const struct HitRecord &hit, const Scene &scene, const struct Config &cfg,
+							   const struct RenderContext &context, Stats &stats, int bounce);
+
+// picks the ray_color kernel specialized for the lights, materials and sample counts used by scene and cfg
+RayColorFn select_ray_color(const Scene &scene, const struct Config &cfg);
 
 struct HitRecord {
 	EntityId entity_id;
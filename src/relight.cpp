@@ -0,0 +1,243 @@
+#include "relight.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+#include <glm/glm.hpp>
+
+#include "context.h"
+#include "hash.h"
+#include "math.h"
+#include "ray.h"
+#include "render.h"
+#include "serialize.h"
+
+static constexpr char kGBufferMagic[4] = {'R', 'T', 'G', 'B'};
+
+static const Material &sample_material(const Scene &scene, const GSample &sample) {
+	return sample.kind == PrimitiveKind::kSphere ? scene.sphere_materials[sample.material]
+												 : scene.plane_materials[sample.material];
+}
+
+// everything a capture depends on besides materials and light intensities
+static std::uint64_t geometry_hash(const Scene &scene) {
+	ContentHash hash;
+	for (auto i = 0; i < scene.spheres.size(); ++i) {
+		const auto &sphere = scene.spheres[i];
+		hash.add(static_cast<std::int64_t>(sphere.id));
+		hash.add(sphere.position);
+		hash.add(sphere.radius);
+		hash.add(static_cast<std::int64_t>(scene.sphere_materials[i].type));
+	}
+	for (auto i = 0; i < scene.planes.size(); ++i) {
+		hash_plane(hash, scene.planes[i]);
+		hash.add(static_cast<std::int64_t>(scene.plane_materials[i].type));
+	}
+	for (const auto &light : scene.directional_lights) hash.add(light.direction);
+	for (auto i = 0; i < scene.area_lights.size(); ++i) {
+		const auto &data = scene.area_light_data[i];
+		hash_plane(hash, scene.area_lights[i]);
+		hash.add(static_cast<std::int64_t>(data.u_samples));
+		hash.add(static_cast<std::int64_t>(data.v_samples));
+		hash.add(data.max_random_offset);
+	}
+	return hash.value;
+}
+
+// traces a camera sample the way ray_color does, keeping the visible light samples instead of shading them
+static GSample capture_sample(const Ray &ray, const Scene &scene, const Camera &cam, const Config &cfg,
+							  RayColorFn ray_color, const RenderContext &context,
+							  std::vector<LightSample> &light_samples, Stats &stats) {
+	auto sample = GSample{.type = GSampleType::kMiss};
+
+	auto closest = hit_scene(ray, scene, context, stats);
+	if (!closest) return sample;
+	auto hit = surface_attributes(ray, scene, closest.value());
+	if (!hit.front_facing) return sample;
+
+	sample.position = hit.position;
+	sample.normal = hit.normal;
+	sample.entity = hit.entity_id;
+	sample.material = static_cast<std::uint16_t>(closest->index);
+	sample.kind = closest->kind;
+	sample.type = hit.material->type == MaterialType::kUnlit ? GSampleType::kUnlit : GSampleType::kLit;
+	if (sample.type == GSampleType::kUnlit) return sample;
+
+	sample.first_light_sample = static_cast<std::uint32_t>(light_samples.size());
+	visible_light_samples(hit, scene, context, stats, 0, [&light_samples](int light, const glm::vec3 &to_light) {
+		light_samples.push_back(LightSample{.direction = to_light, .light = static_cast<std::uint16_t>(light)});
+	});
+	sample.light_samples = static_cast<std::uint16_t>(light_samples.size() - sample.first_light_sample);
+
+	sample.indirect = glm::vec3(0);
+	if (cfg.max_depth > 1) {
+		auto dir = uniform_sample_hemisphere(rand_float(), rand_float());
+		dir = glm::normalize(align_tbn(dir, hit.normal, hit.tangent));
+
+		auto indirect_ray = secondary_ray(hit.position, dir);
+		auto indirect = ray_color(indirect_ray, cam, scene, cfg, context, stats, cfg.max_depth - 1);
+		static const float p = 1.f / (2.f * PI);
+		sample.indirect = indirect * glm::max(0.f, glm::dot(hit.normal, dir)) / p;
+	}
+
+	sample.occlusion = cfg.ambient_occlusion_samples > 0
+					   ? sample_ambient_occlusion(hit, scene, cfg, context, stats, 0) : 0.f;
+	return sample;
+}
+
+void capture_gbuffer(const Scene &scene, const Camera &cam, const Config &cfg, GBuffer &gbuffer, Stats &stats) {
+	auto samples_base = cfg.samples_base;
+	auto samples2 = samples_base * samples_base;
+	auto ray_color = select_ray_color(scene, cfg);
+
+	gbuffer.cam = cam;
+	gbuffer.cfg = cfg;
+	gbuffer.geometry_hash = geometry_hash(scene);
+	gbuffer.samples.assign(static_cast<std::size_t>(cfg.width) * cfg.height * samples2, GSample{});
+
+	// light samples are collected per row and concatenated once all rows are done
+	std::vector<std::vector<LightSample>> row_light_samples(cfg.height);
+	std::atomic<int> next_row = 0;
+
+	const RenderContext context;
+	auto capture_rows = [&](Stats &thread_stats) {
+		for (auto y = next_row++; y < cfg.height; y = next_row++) {
+			seed_random(tile_seed(cfg, glm::ivec4(0, y, cfg.width, y + 1)));
+			for (auto x = 0; x < cfg.width; ++x) {
+				auto offset = ((cfg.height - y - 1) * cfg.width + x) * samples2;
+				for (auto i = 0; i < samples2; ++i) {
+					auto u = (x + ((i % samples_base) + .5f) / samples_base) / cfg.width;
+					auto v = (y + ((i / samples_base) + .5f) / samples_base) / cfg.height;
+					gbuffer.samples[offset + i] = capture_sample(ray_from_camera(cam, u, v), scene, cam, cfg, ray_color,
+																 context, row_light_samples[y], thread_stats);
+				}
+			}
+		}
+	};
+
+	auto threads = render_thread_count(cfg);
+	std::vector<Stats> thread_stats(threads);
+	std::vector<std::thread> workers;
+	for (auto i = 0; i < threads; ++i) workers.emplace_back(capture_rows, std::ref(thread_stats[i]));
+	for (auto &worker : workers) worker.join();
+	for (const auto &s : thread_stats) stats.merge(s);
+
+	std::vector<std::uint32_t> row_start(cfg.height);
+	gbuffer.light_samples.clear();
+	for (auto y = 0; y < cfg.height; ++y) {
+		row_start[y] = static_cast<std::uint32_t>(gbuffer.light_samples.size());
+		gbuffer.light_samples.insert(gbuffer.light_samples.end(), row_light_samples[y].begin(),
+									 row_light_samples[y].end());
+	}
+	for (auto y = 0; y < cfg.height; ++y) {
+		auto first = static_cast<std::size_t>(cfg.height - y - 1) * cfg.width * samples2;
+		for (auto i = first; i < first + cfg.width * samples2; ++i)
+			gbuffer.samples[i].first_light_sample += row_start[y];
+	}
+}
+
+static glm::vec3 shade_sample(const GBuffer &gbuffer, const Scene &scene, const GSample &sample) {
+	if (sample.type == GSampleType::kMiss) return glm::vec3(0);
+	const auto &material = sample_material(scene, sample);
+	if (sample.type == GSampleType::kUnlit) return material.color;
+
+	auto hit = HitRecord{
+			.entity_id = sample.entity,
+			.position = sample.position,
+			.normal = sample.normal,
+			.front_facing = true,
+			.material = &material,
+	};
+
+	glm::vec3 direct(0.f);
+	for (auto i = sample.first_light_sample; i < sample.first_light_sample + sample.light_samples; ++i) {
+		const auto &light_sample = gbuffer.light_samples[i];
+		direct += light_sample_radiance(scene, light_sample.light) *
+				  blinn_phong(hit, gbuffer.cam, light_sample.direction);
+	}
+	direct *= 1.f - sample.occlusion;
+
+	auto indirect = (material.color / PI) * sample.indirect;
+	return glm::clamp(direct + indirect, 0.f, 1.f);
+}
+
+bool relight(const GBuffer &gbuffer, const Scene &scene, int threads, std::vector<glm::vec3> &colors,
+			 std::string &error) {
+	if (geometry_hash(scene) != gbuffer.geometry_hash) {
+		error = "geometry, light placement or material types differ from the capture";
+		return false;
+	}
+	auto materials_valid = std::ranges::all_of(gbuffer.samples, [&scene](const GSample &sample) {
+		if (sample.type == GSampleType::kMiss) return true;
+		const auto &materials = sample.kind == PrimitiveKind::kSphere ? scene.sphere_materials : scene.plane_materials;
+		return sample.material < materials.size();
+	});
+	auto lights = scene.directional_lights.size() + scene.area_lights.size();
+	auto lights_valid = std::ranges::all_of(gbuffer.light_samples, [lights](const LightSample &light_sample) {
+		return light_sample.light < lights;
+	});
+	if (!materials_valid || !lights_valid) {
+		error = "the capture refers to materials or lights the scene does not have";
+		return false;
+	}
+
+	const auto &cfg = gbuffer.cfg;
+	auto samples2 = cfg.samples_base * cfg.samples_base;
+	auto pixels = cfg.width * cfg.height;
+	colors.resize(pixels);
+
+	std::atomic<int> next_row = 0;
+	auto relight_rows = [&]() {
+		for (auto row = next_row++; row < cfg.height; row = next_row++) {
+			for (auto pixel = row * cfg.width; pixel < (row + 1) * cfg.width; ++pixel) {
+				glm::vec3 color(0.f);
+				for (auto i = 0; i < samples2; ++i)
+					color += shade_sample(gbuffer, scene, gbuffer.samples[pixel * samples2 + i]);
+				colors[pixel] = color / static_cast<float>(samples2);
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (auto i = 0; i < glm::max(threads, 1); ++i) workers.emplace_back(relight_rows);
+	for (auto &worker : workers) worker.join();
+	return true;
+}
+
+bool save_gbuffer(const std::string &path, const GBuffer &gbuffer) {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out.write(kGBufferMagic, sizeof(kGBufferMagic));
+	out.write(reinterpret_cast<const char *>(&gbuffer.cam), sizeof(gbuffer.cam));
+	out.write(reinterpret_cast<const char *>(&gbuffer.cfg), sizeof(gbuffer.cfg));
+	out.write(reinterpret_cast<const char *>(&gbuffer.geometry_hash), sizeof(gbuffer.geometry_hash));
+	write_vector(out, gbuffer.samples);
+	write_vector(out, gbuffer.light_samples);
+	return static_cast<bool>(out.flush());
+}
+
+bool load_gbuffer(const std::string &path, GBuffer &gbuffer) {
+	std::ifstream in(path, std::ios::binary);
+	char magic[4];
+	if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + 4, kGBufferMagic)) return false;
+	if (!in.read(reinterpret_cast<char *>(&gbuffer.cam), sizeof(gbuffer.cam)) ||
+		!in.read(reinterpret_cast<char *>(&gbuffer.cfg), sizeof(gbuffer.cfg)) ||
+		!in.read(reinterpret_cast<char *>(&gbuffer.geometry_hash), sizeof(gbuffer.geometry_hash)))
+		return false;
+	if (!read_vector(in, gbuffer.samples) || !read_vector(in, gbuffer.light_samples)) return false;
+
+	const auto &cfg = gbuffer.cfg;
+	if (cfg.width <= 0 || cfg.height <= 0 || cfg.samples_base <= 0) return false;
+	auto samples2 = static_cast<std::size_t>(cfg.samples_base) * cfg.samples_base;
+	if (gbuffer.samples.size() != static_cast<std::size_t>(cfg.width) * cfg.height * samples2) return false;
+
+	// the light samples of a lit sample have to be in the buffer, what they index in the scene is checked by relight
+	return std::ranges::all_of(gbuffer.samples, [&](const GSample &sample) {
+		if (sample.type == GSampleType::kMiss) return true;
+		if (sample.type != GSampleType::kUnlit && sample.type != GSampleType::kLit) return false;
+		if (sample.kind != PrimitiveKind::kSphere && sample.kind != PrimitiveKind::kPlane) return false;
+		return sample.type == GSampleType::kUnlit ||
+			   sample.first_light_sample + std::size_t(sample.light_samples) <= gbuffer.light_samples.size();
+	});
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "camera.h"
+#include "config.h"
+#include "scene.h"
+
+// deferred relighting. a capture traces the frame once and keeps what every camera sample hit, the directions to the
+// light samples it sees and the light it gathered from further bounces. relight shades those samples again with the
+// materials and light intensities of the current scene, without intersecting anything. geometry, light placement,
+// camera and config have to stay as captured. light from further bounces is kept as captured and only picks up the
+// new color of the surface it lands on, so edits of other surfaces and of lights show in it only after a new capture
+
+enum class GSampleType : unsigned char {
+	kMiss = 0, // nothing or a back face was hit, black
+	kUnlit,
+	kLit,
+};
+
+struct GSample {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec3 indirect; // incoming light from further bounces over the hemisphere pdf, before the surface color / PI
+	float occlusion; // ambient occlusion, darkens the direct light
+
+	std::uint32_t first_light_sample; // into GBuffer::light_samples
+	std::uint16_t light_samples;
+
+	EntityId entity;
+	std::uint16_t material; // index into the sphere or plane materials, by kind
+	PrimitiveKind kind;
+	GSampleType type;
+};
+
+// a light sample that was not in shadow. occluded samples add nothing and are left out
+struct LightSample {
+	glm::vec3 direction;
+	std::uint16_t light; // directional lights first, then area lights
+};
+
+struct GBuffer {
+	Camera cam;
+	Config cfg;
+	std::uint64_t geometry_hash; // what relighting must not change
+
+	// cfg.samples_base^2 per pixel, pixels in the order of the color buffer
+	std::vector<GSample> samples;
+	std::vector<LightSample> light_samples;
+};
+
+// traces the frame of cfg on render_thread_count threads
+void capture_gbuffer(const Scene &scene, const Camera &cam, const Config &cfg, GBuffer &gbuffer, Stats &stats);
+
+// shades every sample with the materials and lights of scene into colors (linear, width * height). fails with a
+// reason if scene moved anything the buffer depends on
+bool relight(const GBuffer &gbuffer, const Scene &scene, int threads, std::vector<glm::vec3> &colors,
+			 std::string &error);
+
+// raw copies, only meant to be read back by the same build
+bool save_gbuffer(const std::string &path, const GBuffer &gbuffer);
+bool load_gbuffer(const std::string &path, GBuffer &gbuffer);
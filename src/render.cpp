@@ -0,0 +1,532 @@
+#include "render.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <glm/glm.hpp>
+
+#include "hash.h"
+#include "image.h"
+#include "integrator.h"
+#include "math.h"
+#include "reservoir.h"
+#include "trace.h"
+
+using Clock = std::chrono::steady_clock;
+
+// samples_base of the tiles that are filled in after the deadline, one sample per pixel
+static constexpr int kFillSamplesBase = 1;
+
+static double elapsed_ms(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+std::uint64_t task_hash(const RenderingTask &task) {
+	auto value = render_hash(task.scene, task.cam, task.cfg);
+	if (!task.context.lightmaps) return value;
+
+	ContentHash hash;
+	hash.add(static_cast<std::int64_t>(value));
+	hash.add(static_cast<std::int64_t>(lightmaps_hash(*task.context.lightmaps)));
+	return hash.value;
+}
+
+std::uint32_t tile_seed(const Config &cfg, const glm::ivec4 &rect) {
+	std::seed_seq seq{cfg.seed, static_cast<unsigned int>(rect.x), static_cast<unsigned int>(rect.y)};
+	std::uint32_t seed;
+	seq.generate(&seed, &seed + 1);
+	return seed;
+}
+
+// camera ray of sample i of the pixel at x, y, samples are spread over the pixel on a samples_base^2 grid
+static Ray camera_ray(const RenderingTask &task, int x, int y, int i, int samples_base) {
+	auto u = static_cast<float>(x) / task.cfg.width;
+	auto v = static_cast<float>(y) / task.cfg.height;
+	u += ((i % samples_base) + .5f) * (1.f / task.cfg.width / samples_base);
+	v += ((i / samples_base) + .5f) * (1.f / task.cfg.height / samples_base);
+	return ray_from_camera(task.cam, u, v);
+}
+
+static bool stopped(const RenderingTask &task) {
+	return task.stop_token.stop_requested() || Clock::now() >= task.deadline;
+}
+
+// surface at closest if it is the front of a lit surface
+static std::optional<HitRecord> lit_hit(const RenderingTask &task, const Ray &ray, const std::optional<Hit> &closest) {
+	if (!closest) return {};
+	auto hit = surface_attributes(ray, task.scene, *closest);
+	if (!hit.front_facing || hit.material->type != MaterialType::kBlinnPhong) return {};
+	return hit;
+}
+
+// render_rows for cfg.resample_lights. the rows are rendered in samples_base^2 passes over all of them, every pass
+// makes the light reservoirs of its camera hits, merges them with those of the pass before and then with those of
+// nearby pixels before it shades. reservoirs only travel within the rows, so a tile comes out the same on any thread.
+// camera rays are traced once and their hits shaded with hit_color, the generic kernel, so a camera hit costs one
+// shadow ray plus whatever its bounces and ambient occlusion trace. if interruptible it stops before the next pass
+// and returns first_row, the passes done are dropped
+static int render_rows_resampled(const RenderingTask &task, const glm::ivec4 &rect, int first_row, int samples_base,
+								 int first_sample, const Config &shading, const RenderContext &context, Stats &stats,
+								 bool interruptible) {
+	auto width = rect.z - rect.x;
+	auto pixels = width * (rect.w - first_row);
+	auto samples2 = samples_base * samples_base;
+
+	std::vector<glm::vec3> colors(pixels, glm::vec3(0));
+	std::vector<PixelCost> costs(task.pixel_costs ? pixels : 0);
+	std::vector<std::optional<Hit>> closest(pixels);
+	std::vector<std::optional<HitRecord>> hits(pixels); // the lit ones of closest
+	std::vector<Reservoir> candidates(pixels);
+	std::vector<Reservoir> reservoirs(pixels); // what the last pass shaded with
+	seed_random(tile_seed(task.cfg, glm::ivec4(rect.x, first_row, rect.z, rect.w)));
+	auto sample_context = context;
+
+	// runs fn for every pixel, adding what it costs to costs
+	auto for_pixels = [&](auto &&fn) {
+		for (auto y = first_row; y < rect.w; ++y) {
+			for (auto x = rect.x; x < rect.z; ++x) {
+				auto pixel = (y - first_row) * width + x - rect.x;
+				auto rays_before = stats.ray_count;
+				auto pixel_start = task.pixel_costs ? Clock::now() : Clock::time_point();
+				fn(x, y, pixel);
+				if (task.pixel_costs) {
+					costs[pixel].rays += static_cast<unsigned int>(stats.ray_count - rays_before);
+					costs[pixel].time_us += static_cast<float>(elapsed_ms(pixel_start, Clock::now()) * 1e3);
+				}
+			}
+		}
+	};
+
+	for (auto i = first_sample; i < samples2; ++i) {
+		if (interruptible && stopped(task)) return first_row;
+
+		for_pixels([&](int x, int y, int pixel) {
+			auto ray = camera_ray(task, x, y, i, samples_base);
+			closest[pixel] = hit_scene(ray, task.scene, context, stats);
+			hits[pixel] = lit_hit(task, ray, closest[pixel]);
+			if (!hits[pixel]) return;
+			const auto &hit = *hits[pixel];
+			candidates[pixel] = sample_lights(hit, task.cam, task.scene);
+
+			auto previous = reservoirs[pixel];
+			if (previous.count == 0 || !similar_surface(hit, task.cam, previous)) return;
+			previous.count = glm::min(previous.count, kReuseHistory * kLightCandidates);
+			const Reservoir *merged[] = {&candidates[pixel], &previous};
+			candidates[pixel] = merge_reservoirs(hit, task.cam, task.scene, merged, 2);
+		});
+
+		for_pixels([&](int x, int y, int pixel) {
+			if (!hits[pixel]) {
+				reservoirs[pixel] = Reservoir{};
+				return;
+			}
+			const auto &hit = *hits[pixel];
+			std::array<const Reservoir *, kReuseNeighbors + 1> merged{&candidates[pixel]};
+			auto count = 1;
+			for (auto n = 0; n < kReuseNeighbors; ++n) {
+				auto nx = glm::clamp(x + static_cast<int>(rand_float(-1.f, 1.f) * kReuseRadius), rect.x, rect.z - 1);
+				auto ny = glm::clamp(y + static_cast<int>(rand_float(-1.f, 1.f) * kReuseRadius), first_row, rect.w - 1);
+				auto neighbor = (ny - first_row) * width + nx - rect.x;
+				if (neighbor == pixel || !hits[neighbor] || !similar_surface(hit, task.cam, candidates[neighbor]))
+					continue;
+				merged[count++] = &candidates[neighbor];
+			}
+			reservoirs[pixel] = merge_reservoirs(hit, task.cam, task.scene, merged.data(), count);
+		});
+
+		for_pixels([&](int x, int y, int pixel) {
+			if (!closest[pixel]) {
+				++stats.path_length[1];
+				return;
+			}
+			sample_context.light_reservoir = hits[pixel] ? &reservoirs[pixel] : nullptr;
+			auto ray = camera_ray(task, x, y, i, samples_base);
+			colors[pixel] += hit_color(ray, *closest[pixel], task.cam, task.scene, shading, sample_context, stats,
+									   shading.max_depth);
+		});
+	}
+
+	for (auto y = first_row; y < rect.w; ++y) {
+		auto row = colors.begin() + (y - first_row) * width;
+		auto offset = (task.cfg.height - y - 1) * task.cfg.width + rect.x;
+		for (auto x = 0; x < width; ++x) {
+			if (first_sample > 0) row[x] += task.trained_colors[offset + x];
+			row[x] /= static_cast<float>(samples2);
+		}
+
+		tone_map(&*row, width, task.pixel_buffer + offset * 3);
+		if (task.color_buffer) std::copy(row, row + width, task.color_buffer + offset);
+		if (task.pixel_costs) std::copy_n(costs.begin() + (y - first_row) * width, width, task.pixel_costs + offset);
+	}
+	return rect.w;
+}
+
+// renders rows [first_row, rect.w) of rect at samples_base^2 samples per pixel, shaded by ray_color with the depth,
+// ambient occlusion and lighting settings of shading. the samples before first_sample were traced by train_guiding
+// and are taken from task.trained_colors. if interruptible it stops at the next row once the task is stopped or past
+// its deadline and returns the first row it left out
+static int render_rows(const RenderingTask &task, const glm::ivec4 &rect, int first_row, int samples_base,
+					   int first_sample, RayColorFn ray_color, const Config &shading, const RenderContext &context,
+					   Stats &stats, bool interruptible) {
+	if (shading.resample_lights && shading.integrator == Integrator::kPath) {
+		return render_rows_resampled(task, rect, first_row, samples_base, first_sample, shading, context, stats,
+									 interruptible);
+	}
+	if (shading.resample_lights && shading.integrator == Integrator::kDirect) {
+		auto direct = shading;
+		direct.max_depth = 1;
+		return render_rows_resampled(task, rect, first_row, samples_base, first_sample, direct, context, stats,
+									 interruptible);
+	}
+
+	auto samples2 = static_cast<float>(samples_base * samples_base);
+
+	std::vector<glm::vec3> row(rect.z - rect.x);
+	seed_random(tile_seed(task.cfg, glm::ivec4(rect.x, first_row, rect.z, rect.w)));
+
+	for (auto y = first_row; y < rect.w; y++) {
+		if (interruptible && stopped(task)) return y;
+
+		auto offset = (task.cfg.height - y - 1) * task.cfg.width + rect.x;
+		for (auto x = rect.x; x < rect.z; x++) {
+			auto &color = row[x - rect.x];
+			color = first_sample > 0 ? task.trained_colors[offset + x - rect.x] : glm::vec3();
+
+			auto rays_before = stats.ray_count;
+			auto pixel_start = task.pixel_costs ? Clock::now() : Clock::time_point();
+
+			for (auto i = first_sample; i < samples2; ++i) {
+				auto r = camera_ray(task, x, y, i, samples_base);
+				color += ray_color(r, task.cam, task.scene, shading, context, stats, shading.max_depth);
+			}
+
+			color /= samples2;
+
+			if (task.pixel_costs) {
+				auto &cost = task.pixel_costs[(task.cfg.height - y - 1) * task.cfg.width + x];
+				cost.rays = static_cast<unsigned int>(stats.ray_count - rays_before);
+				cost.time_us = static_cast<float>(elapsed_ms(pixel_start, Clock::now()) * 1e3);
+			}
+		}
+
+		tone_map(row.data(), rect.z - rect.x, task.pixel_buffer + offset * 3);
+		if (task.color_buffer) std::copy(row.begin(), row.end(), task.color_buffer + offset);
+	}
+	return rect.w;
+}
+
+int render_tile(const RenderingTask &task, const glm::ivec4 &rect, const RenderContext &context, Stats &stats) {
+	return render_rows(task, rect, rect.y, task.cfg.samples_base, task.trained_samples, task.ray_color, task.cfg,
+					   context, stats, true);
+}
+
+void fill_tile(const RenderingTask &task, const glm::ivec4 &rect, int first_row, const RenderContext &context,
+			   Stats &stats) {
+	// the fill only has to cover what the deadline cut off, so it leaves out bounces, ambient occlusion and resampling
+	auto shading = task.cfg;
+	shading.max_depth = 1;
+	shading.ambient_occlusion_samples = 0;
+	shading.resample_lights = false;
+	auto fill_color = select_integrator(task.scene, shading);
+	render_rows(task, rect, first_row, kFillSamplesBase, 0, fill_color, shading, context, stats, false);
+}
+
+// copies a cached tile into the task's buffers
+static bool load_cached_tile(const RenderingTask &task, const glm::ivec4 &rect) {
+	std::vector<glm::vec3> colors;
+	if (!task.cache->load_tile(task.content_hash, rect, colors)) return false;
+
+	auto w = rect.z - rect.x;
+	for (auto row = 0; row < rect.w - rect.y; ++row) {
+		auto offset = (task.cfg.height - rect.w + row) * task.cfg.width + rect.x;
+		std::copy_n(colors.begin() + row * w, w, task.color_buffer + offset);
+		tone_map(task.color_buffer + offset, w, task.pixel_buffer + offset * 3);
+	}
+	return true;
+}
+
+static void store_cached_tile(const RenderingTask &task, const glm::ivec4 &rect) {
+	auto w = rect.z - rect.x;
+	std::vector<glm::vec3> colors(w * (rect.w - rect.y));
+	for (auto row = 0; row < rect.w - rect.y; ++row) {
+		auto offset = (task.cfg.height - rect.w + row) * task.cfg.width + rect.x;
+		std::copy_n(task.color_buffer + offset, w, colors.begin() + row * w);
+	}
+	task.cache->store_tile(task.content_hash, rect, colors);
+}
+
+static std::vector<EntityId> touched_entities(const std::vector<std::uint64_t> &bits) {
+	std::vector<EntityId> entities;
+	for (auto word = 0; word < bits.size(); ++word) {
+		for (auto bit = 0; bit < 64; ++bit)
+			if (bits[word] & (std::uint64_t(1) << bit)) entities.push_back(static_cast<EntityId>(word * 64 + bit));
+	}
+	return entities;
+}
+
+static void generate_image_part(RenderingTask &task, int thread) {
+	auto &times = task.thread_times[thread];
+	Stats stats;
+	auto context = task.context;
+
+	std::vector<std::uint64_t> touched;
+	if (task.record_entities) {
+		touched.resize((task.scene.next_entity_id + 63) / 64);
+		context.touched_entities = touched.data();
+	}
+
+	std::optional<PerfCounters> counters;
+	if (task.perf_counters) {
+		counters.emplace();
+		counters->start();
+	}
+
+	while (true) {
+		glm::ivec4 rect;
+
+		auto wait_start = Clock::now();
+		{
+			TRACE_SCOPE("tile queue wait", "queue");
+			const std::lock_guard guard(task.queue_mutex);
+			if (task.rectangles.empty() || task.stop_token.stop_requested()) break;
+			rect = task.rectangles.front();
+			task.rectangles.pop();
+		}
+		auto tile_start = Clock::now();
+		times.tile_wait_ms += elapsed_ms(wait_start, tile_start);
+
+		std::fill(touched.begin(), touched.end(), 0);
+		if (task.cache && !task.record_entities && load_cached_tile(task, rect)) {
+			++times.tiles_cached;
+			if (task.on_tile_done) task.on_tile_done(rect);
+			continue;
+		}
+
+		// past the deadline the tiles that are left only get a quick fill, so the frame is complete in time
+		auto first_missing = rect.y;
+		if (tile_start < task.deadline) {
+			TRACE_SCOPE("tile", "render", rect.x, rect.y, rect.z, rect.w);
+			first_missing = render_tile(task, rect, context, stats);
+		}
+		if (first_missing < rect.w) {
+			if (task.stop_token.stop_requested()) {
+				// cut short by a stop, it goes back with the other tiles that are left unrendered
+				const std::lock_guard guard(task.queue_mutex);
+				task.rectangles.push(rect);
+				break;
+			}
+
+			TRACE_SCOPE("tile fill", "render", rect.x, first_missing, rect.z, rect.w);
+			fill_tile(task, rect, first_missing, context, stats);
+			task.tiles_filled[tile_index(task.cfg, rect)] = true;
+			++times.tiles_filled;
+		} else if (task.cache) {
+			store_cached_tile(task, rect);
+		}
+		if (task.record_entities) task.tile_entities[tile_index(task.cfg, rect)] = touched_entities(touched);
+
+		times.busy_ms += elapsed_ms(tile_start, Clock::now());
+		++times.tiles;
+
+		if (task.on_tile_done && task.cfg.integrator != Integrator::kBidirectional) task.on_tile_done(rect);
+	}
+
+	times.rays = stats.ray_count;
+
+	if (counters) {
+		counters->stop();
+		task.thread_perf[thread] = counters->read();
+	}
+
+	const std::lock_guard guard(task.queue_mutex);
+	task.stats.merge(stats);
+	if (counters && !counters->error.empty() && task.perf_error.empty()) task.perf_error = counters->error;
+}
+
+int tile_index(const Config &cfg, const glm::ivec4 &rect) {
+	auto tiles_per_column = (cfg.height + cfg.tile_size - 1) / cfg.tile_size;
+	return rect.x / cfg.tile_size * tiles_per_column + rect.y / cfg.tile_size;
+}
+
+std::vector<glm::ivec4> image_tiles(const Config &cfg) {
+	std::vector<glm::ivec4> tiles;
+	for (auto x = 0; x < cfg.width; x += cfg.tile_size) {
+		for (auto y = 0; y < cfg.height; y += cfg.tile_size) {
+			tiles.emplace_back(x, y, glm::min(cfg.width, x + cfg.tile_size), glm::min(cfg.height, y + cfg.tile_size));
+		}
+	}
+	return tiles;
+}
+
+int render_thread_count(const Config &cfg) {
+	if (cfg.threads > 0) return cfg.threads;
+	return glm::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// traces the first cfg.guiding_passes samples of every pixel frame by frame, at most all but the last, and sums them
+// into task.trained_colors for the tiles to finish. every pass trains the guide and samples from what the passes
+// before it learned
+static void train_guiding(RenderingTask &task, GuidingTree &guiding, int threads) {
+	const auto &cfg = task.cfg;
+	task.trained_colors.assign(std::size_t(cfg.width) * cfg.height, glm::vec3(0));
+	task.trained_samples = 0;
+
+	auto passes = glm::min(cfg.guiding_passes, cfg.samples_base * cfg.samples_base - 1);
+	for (auto pass = 0; pass < passes; ++pass) {
+		TRACE_SCOPE("guiding pass", "render");
+		std::atomic<int> next_row = 0;
+
+		auto train_rows = [&]() {
+			Stats stats;
+			auto context = RenderContext{
+					.lightmaps = task.context.lightmaps,
+					.guiding = &guiding,
+					.record_guiding = true,
+			};
+
+			for (auto y = next_row++; y < cfg.height && !task.stop_token.stop_requested(); y = next_row++) {
+				// negative columns keep the seeds apart from those of the tiles
+				seed_random(tile_seed(cfg, glm::ivec4(-1 - pass, y, 0, 0)));
+				auto row = task.trained_colors.begin() + (cfg.height - y - 1) * cfg.width;
+				for (auto x = 0; x < cfg.width; ++x) {
+					auto ray = camera_ray(task, x, y, pass, cfg.samples_base);
+					row[x] += task.ray_color(ray, task.cam, task.scene, cfg, context, stats, cfg.max_depth);
+				}
+			}
+
+			const std::lock_guard guard(task.queue_mutex);
+			task.stats.merge(stats);
+		};
+
+		std::vector<std::thread> workers;
+		for (auto i = 0; i < threads; ++i) workers.emplace_back(train_rows);
+		for (auto &worker : workers) worker.join();
+		guiding.refine();
+		task.trained_samples = pass + 1;
+	}
+}
+
+void generate_image(RenderingTask &task) {
+	const auto cores = render_thread_count(task.cfg);
+
+	auto bidirectional = task.cfg.integrator == Integrator::kBidirectional;
+	task.ray_color = select_integrator(task.scene, task.cfg);
+
+	auto tiles = image_tiles(task.cfg);
+	task.tiles_filled.assign(tiles.size(), false);
+	task.thread_times.assign(cores, ThreadTimes{});
+	task.thread_perf.assign(task.perf_counters ? cores : 0, PerfCounts{});
+
+	auto start = Clock::now();
+
+	// entries hold linear colors, without a color buffer there is nothing to store. bidirectional paths splat into
+	// tiles other than their own, so neither tiles nor unfinished frames mean anything on their own
+	if (!task.color_buffer || bidirectional) task.cache = nullptr;
+	if (task.record_entities) task.tile_entities.resize(tiles.size());
+	if (task.cache) {
+		TRACE_SCOPE("frame cache lookup", "cache");
+		task.content_hash = task_hash(task);
+
+		std::vector<glm::vec3> colors;
+		if (!task.record_entities &&
+			task.cache->load_frame(task.content_hash, task.cfg.tile_size, task.cfg.width, task.cfg.height, colors)) {
+			std::copy(colors.begin(), colors.end(), task.color_buffer);
+			tone_map(task.color_buffer, static_cast<int>(colors.size()), task.pixel_buffer);
+			for (const auto &rect : tiles)
+				if (task.on_tile_done) task.on_tile_done(rect);
+
+			task.duration_ms = elapsed_ms(start, Clock::now());
+			if (task.on_frame_done) task.on_frame_done();
+			return;
+		}
+	}
+
+	// lightmaps hold the indirect light of their planes as well, the direct integrator traces the lights instead
+	auto lightmaps = task.context.lightmaps;
+	if (task.cfg.integrator == Integrator::kDirect) task.context.lightmaps = nullptr;
+
+	std::optional<IrradianceCache> irradiance_cache;
+	if (task.cfg.irradiance_error > 0) {
+		glm::vec3 min, max;
+		scene_bounds(task.scene, min, max);
+		irradiance_cache.emplace(min, max, task.cfg.irradiance_error);
+		task.context.irradiance_cache = &*irradiance_cache;
+	}
+	std::optional<AmbientOcclusionCache> ao_cache;
+	if (task.cfg.ao_cache_cell > 0) {
+		ao_cache.emplace(task.cfg.ao_cache_cell, task.cfg.ao_cache_confidence);
+		task.context.ao_cache = &*ao_cache;
+	}
+	std::optional<GuidingTree> guiding;
+	if (task.cfg.guiding_passes > 0 && task.cfg.max_depth > 1 && task.cfg.integrator == Integrator::kPath) {
+		glm::vec3 min, max;
+		scene_bounds(task.scene, min, max);
+		guiding.emplace(min, max);
+		train_guiding(task, *guiding, cores);
+		task.context.guiding = &*guiding;
+	}
+
+	// the splats are resolved into linear colors, a task without a color buffer gets one for the frame
+	std::optional<LightImage> light_image;
+	std::vector<glm::vec3> linear_colors;
+	if (bidirectional) {
+		light_image.emplace(task.cfg.width, task.cfg.height);
+		task.context.light_image = &*light_image;
+		if (!task.color_buffer) {
+			linear_colors.resize(std::size_t(task.cfg.width) * task.cfg.height);
+			task.color_buffer = linear_colors.data();
+		}
+	}
+
+	// tiles done before miss the splats of the tiles rendered now, bidirectional frames are rendered whole
+	for (auto i = 0; i < tiles.size(); ++i)
+		if (bidirectional || i >= task.tiles_done.size() || !task.tiles_done[i]) task.rectangles.push(tiles[i]);
+
+	std::vector<std::thread> threads;
+	{
+		TRACE_SCOPE("spawn threads", "setup");
+		for (auto i = 0; i < cores; ++i) {
+			std::thread t([&task, i]() {
+				trace_thread_name("render " + std::to_string(i));
+				generate_image_part(task, i);
+			});
+			threads.emplace_back(std::move(t));
+		}
+	}
+
+	for (auto &t : threads) t.join();
+	task.trained_samples = 0;
+	task.trained_colors.clear();
+	task.context.lightmaps = lightmaps;
+	task.context.irradiance_cache = nullptr;
+	task.context.ao_cache = nullptr;
+	task.context.guiding = nullptr;
+
+	if (light_image) {
+		TRACE_SCOPE("resolve splats", "render");
+		light_image->resolve(task.color_buffer);
+		tone_map(task.color_buffer, task.cfg.width * task.cfg.height, task.pixel_buffer);
+		task.context.light_image = nullptr;
+		if (!linear_colors.empty()) task.color_buffer = nullptr;
+	}
+
+	// a frame cut short by a stop or the deadline is not what the key stands for
+	auto complete = task.rectangles.empty() &&
+					std::ranges::none_of(task.tiles_filled, [](char filled) { return filled; });
+	if (task.cache && complete) {
+		TRACE_SCOPE("frame cache store", "cache");
+		task.cache->store_frame(task.content_hash, task.cfg.tile_size, task.cfg.width, task.cfg.height,
+								task.color_buffer);
+	}
+
+	task.duration_ms = elapsed_ms(start, Clock::now());
+	for (auto &times : task.thread_times)
+		times.idle_ms = glm::max(0.0, task.duration_ms - times.busy_ms - times.tile_wait_ms);
+	if (task.on_frame_done) task.on_frame_done();
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "cache.h"
+#include "camera.h"
+#include "config.h"
+#include "context.h"
+#include "perf.h"
+#include "ray.h"
+#include "scene.h"
+
+// where a render thread spent its time, idle is the part of the frame it neither rendered nor waited for a tile
+struct ThreadTimes {
+	double busy_ms = 0;
+	double tile_wait_ms = 0;
+	double idle_ms = 0;
+	int tiles = 0;
+	int tiles_filled = 0; // tiles, or what was left of them, rendered at fill quality after the deadline
+	int tiles_cached = 0; // tiles taken from the cache instead of rendered
+	std::uint64_t rays = 0;
+};
+
+// what a single pixel cost to render, summed over all its samples
+struct PixelCost {
+	unsigned int rays = 0;
+	float time_us = 0;
+};
+
+struct RenderingTask {
+	const Config &cfg;
+	const Camera &cam;
+	const Scene &scene;
+
+	Stats stats; // merged from the per thread stats once a thread ran out of tiles
+	char *pixel_buffer;
+
+	// optional, filled in the same pixel order as pixel_buffer
+	PixelCost *pixel_costs = nullptr;
+	glm::vec3 *color_buffer = nullptr; // linear colors before tone mapping
+
+	RayColorFn ray_color = nullptr;
+
+	// optional, frames and tiles found in it are copied instead of rendered and new ones are stored. needs
+	// color_buffer
+	RenderCache *cache = nullptr;
+	std::uint64_t content_hash = 0; // render_hash of the task, set by generate_image when there is a cache
+
+	// shared by the render threads. context.lightmaps is optional and baked for scene, planes with a lightmap are
+	// shaded from it instead of traced unless cfg.integrator is direct light. generate_image sets the irradiance and
+	// ambient occlusion caches cfg.irradiance_error and cfg.ao_cache_cell ask for, the guide once cfg.guiding_passes
+	// trained it and the light image of the bidirectional integrator while it renders
+	RenderContext context;
+
+	// checked before every tile and every tile row, once stop is requested the remaining tiles are left unrendered
+	std::stop_token stop_token;
+	// checked like stop_token, once it passed the rest of the frame is filled at one sample per pixel instead
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+	// called by the render thread that finished a tile, after its pixels were written. bidirectional frames splat into
+	// every tile until the last one is done, they never call it
+	std::function<void(const glm::ivec4 &rect)> on_tile_done;
+	// called once by generate_image when it is done with the frame, after the last pixel was written
+	std::function<void()> on_frame_done;
+
+	// when set, generate_image records the EntityIds the rays of every tile it renders hit in tile_entities, sorted.
+	// tiles are then always rendered, a cache entry does not know what it hit
+	bool record_entities = false;
+	std::vector<std::vector<EntityId>> tile_entities; // indexed like image_tiles
+
+	// set by generate_image while it renders with a guide, the sums of the first trained_samples samples of every pixel
+	// that trained it. same pixel order as pixel_buffer
+	int trained_samples = 0;
+	std::vector<glm::vec3> trained_colors;
+
+	// indexed like image_tiles, tiles that are set keep what the buffers already hold and are not rendered again
+	std::vector<bool> tiles_done;
+	// indexed like image_tiles, set by generate_image for tiles that were filled in after the deadline. one byte per
+	// tile, render threads set them concurrently
+	std::vector<char> tiles_filled;
+
+	std::mutex queue_mutex;
+	std::queue<glm::ivec4> rectangles;
+
+	std::vector<ThreadTimes> thread_times;
+	double duration_ms = 0;
+
+	// hardware counters per render thread, only collected if perf_counters is set
+	bool perf_counters = false;
+	std::vector<PerfCounts> thread_perf;
+	std::string perf_error;
+};
+
+// number of render threads cfg asks for, every hardware thread if cfg.threads is not set
+int render_thread_count(const Config &cfg);
+
+// splits the image into cfg.tile_size squares (x0, y0, x1, y1), in the order generate_image renders them
+std::vector<glm::ivec4> image_tiles(const Config &cfg);
+
+// sampler seed of the tile at rect, from cfg.seed and the tile position
+std::uint32_t tile_seed(const Config &cfg, const glm::ivec4 &rect);
+
+// index of the tile at rect in image_tiles
+int tile_index(const Config &cfg, const glm::ivec4 &rect);
+
+// render_hash of the task's scene, camera and config, with the lightmaps it reads
+std::uint64_t task_hash(const RenderingTask &task);
+
+// renders rect into the task's buffers, task.ray_color has to be set. stops early once the task is stopped or past
+// its deadline, returns the first row left unrendered or rect.w for a complete tile
+int render_tile(const RenderingTask &task, const glm::ivec4 &rect, const RenderContext &context, Stats &stats);
+
+// renders rows first_row to rect.w at one sample per pixel without bounces or ambient occlusion, to complete a tile
+// cut short by the deadline
+void fill_tile(const RenderingTask &task, const glm::ivec4 &rect, int first_row, const RenderContext &context,
+			   Stats &stats);
+
+void generate_image(RenderingTask &task);
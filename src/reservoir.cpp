@@ -0,0 +1,152 @@
+#include "reservoir.h"
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "context.h"
+#include "math.h"
+#include "scene.h"
+
+// largest difference in depth, relative to the depth of the hit, and smallest cosine between the normals of
+// reservoirs that are merged
+static constexpr float kSimilarDepth = .1f;
+static constexpr float kSimilarNormal = .906f; // 25 degrees
+
+static float luminance(const glm::vec3 &color) {
+	return (color.x + color.y + color.z) / 3.f;
+}
+
+static int light_count(const Scene &scene) {
+	return static_cast<int>(scene.directional_lights.size() + scene.area_lights.size());
+}
+
+// jitters the position within one of the u_samples * v_samples cells like ray_color does
+static glm::vec2 sample_area_light(const AreaLight &data) {
+	auto mro = data.max_random_offset;
+	auto u = glm::min(static_cast<int>(rand_float() * data.u_samples), data.u_samples - 1);
+	auto v = glm::min(static_cast<int>(rand_float() * data.v_samples), data.v_samples - 1);
+	return {(u + .5f + rand_float(-mro, mro)) / data.u_samples, (v + .5f + rand_float(-mro, mro)) / data.v_samples};
+}
+
+static glm::vec3 area_light_point(const Plane &plane, const glm::vec2 &uv) {
+	auto corner = plane.position - plane.bi_tangent * (plane.width * .5f) - plane.tangent * (plane.height * .5f);
+	return corner + plane.bi_tangent * (uv.x * plane.width) + plane.tangent * (uv.y * plane.height);
+}
+
+// direction from position towards the sample, and false if the sample gives position no light whatever the surface
+static bool light_direction(const Scene &scene, int light, const glm::vec2 &uv, const glm::vec3 &position,
+							glm::vec3 &to_light) {
+	auto directional = static_cast<int>(scene.directional_lights.size());
+	if (light < directional) {
+		to_light = -scene.directional_lights[light].direction;
+		return true;
+	}
+
+	const auto &plane = scene.area_lights[light - directional];
+	to_light = glm::normalize(area_light_point(plane, uv) - position);
+	// ray_color ignores every object above the light
+	return glm::dot(to_light, plane.normal) <= 0.f;
+}
+
+// light the sample gives hit without shadows, the integrand the reservoirs estimate
+static glm::vec3 unshadowed_light(const HitRecord &hit, const Camera &camera, const Scene &scene, int light,
+								  const glm::vec2 &uv, glm::vec3 &to_light) {
+	if (!light_direction(scene, light, uv, hit.position, to_light)) return glm::vec3(0);
+
+	auto directional = static_cast<int>(scene.directional_lights.size());
+	if (light < directional) {
+		const auto &l = scene.directional_lights[light];
+		return l.intensity * l.color * blinn_phong(hit, camera, to_light);
+	}
+	const auto &data = scene.area_light_data[light - directional];
+	return data.color * data.intensity * blinn_phong(hit, camera, to_light);
+}
+
+static float target(const HitRecord &hit, const Camera &camera, const Scene &scene, int light, const glm::vec2 &uv) {
+	glm::vec3 to_light;
+	return luminance(unshadowed_light(hit, camera, scene, light, uv, to_light));
+}
+
+static void update(Reservoir &reservoir, int light, const glm::vec2 &uv, float weight) {
+	if (weight <= 0.f) return;
+	reservoir.weight_sum += weight;
+	if (rand_float() * reservoir.weight_sum < weight) {
+		reservoir.light = light;
+		reservoir.uv = uv;
+	}
+}
+
+Reservoir sample_lights(const HitRecord &hit, const Camera &camera, const Scene &scene) {
+	auto reservoir = Reservoir{.position = hit.position, .normal = hit.normal};
+	auto lights = light_count(scene);
+	if (lights == 0) return reservoir;
+
+	// lights are picked uniformly and so are the points on them, the density of a candidate is one over lights
+	auto directional = static_cast<int>(scene.directional_lights.size());
+	for (auto i = 0; i < kLightCandidates; ++i) {
+		auto light = glm::min(static_cast<int>(rand_float() * lights), lights - 1);
+		auto uv = light < directional ? glm::vec2(0) : sample_area_light(scene.area_light_data[light - directional]);
+		update(reservoir, light, uv, target(hit, camera, scene, light, uv) * lights);
+	}
+	reservoir.count = kLightCandidates;
+
+	auto chosen = reservoir.light >= 0 ? target(hit, camera, scene, reservoir.light, reservoir.uv) : 0.f;
+	reservoir.weight = chosen > 0.f ? reservoir.weight_sum / (kLightCandidates * chosen) : 0.f;
+	return reservoir;
+}
+
+Reservoir merge_reservoirs(const HitRecord &hit, const Camera &camera, const Scene &scene,
+						   const Reservoir *const *reservoirs, int count) {
+	auto merged = Reservoir{.position = hit.position, .normal = hit.normal};
+	for (auto i = 0; i < count; ++i) {
+		const auto &r = *reservoirs[i];
+		merged.count += r.count;
+		if (r.light < 0) continue;
+		update(merged, r.light, r.uv, target(hit, camera, scene, r.light, r.uv) * r.weight * r.count);
+	}
+	if (merged.light < 0) return merged;
+
+	// only the reservoirs that could have picked the sample count towards its weight, which keeps the merge unbiased
+	// when the surfaces see different parts of the lights
+	auto candidates = 0;
+	for (auto i = 0; i < count; ++i) {
+		const auto &r = *reservoirs[i];
+		glm::vec3 to_light;
+		if (light_direction(scene, merged.light, merged.uv, r.position, to_light) && glm::dot(r.normal, to_light) > 0.f)
+			candidates += r.count;
+	}
+	auto chosen = target(hit, camera, scene, merged.light, merged.uv);
+	merged.weight = chosen > 0.f && candidates > 0 ? merged.weight_sum / (candidates * chosen) : 0.f;
+	return merged;
+}
+
+bool similar_surface(const HitRecord &hit, const Camera &camera, const Reservoir &other) {
+	auto depth = glm::length(hit.position - camera.position);
+	auto other_depth = glm::length(other.position - camera.position);
+	return glm::abs(depth - other_depth) <= kSimilarDepth * depth &&
+		   glm::dot(hit.normal, other.normal) >= kSimilarNormal;
+}
+
+glm::vec3 resampled_direct_light(const HitRecord &hit, const Camera &camera, const Scene &scene,
+								 const Reservoir &reservoir, const RenderContext &context, Stats &stats, int bounce) {
+	if (reservoir.light < 0 || reservoir.weight <= 0.f) return glm::vec3(0);
+
+	glm::vec3 to_light;
+	auto light = unshadowed_light(hit, camera, scene, reservoir.light, reservoir.uv, to_light);
+	if (luminance(light) <= 0.f) return glm::vec3(0);
+
+	auto light_ray = secondary_ray(hit.position, to_light);
+	auto light_hit = hit_scene(light_ray, scene, context, stats);
+	++stats.shadow_rays[bounce];
+
+	// like ray_color, nothing but the area light itself may be in the way of one, and nothing at all of the others
+	auto directional = static_cast<int>(scene.directional_lights.size());
+	auto visible = reservoir.light < directional
+				   ? !light_hit
+				   : !light_hit || hit_entity(scene, *light_hit) == scene.area_lights[reservoir.light - directional].id;
+	if (!visible) {
+		++stats.shadow_hits[bounce];
+		return glm::vec3(0);
+	}
+	return light * reservoir.weight;
+}
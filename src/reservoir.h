@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "ray.h"
+
+// resampled direct light after bitterli et al., spatiotemporal reservoir resampling. the camera hit of every pixel
+// streams kLightCandidates light samples into a reservoir that keeps one of them, weighed by its unshadowed light.
+// the reservoir is merged with the one the pixel had in the sample pass before and with those of nearby pixels, and
+// only the sample left in the end gets a shadow ray. the unshadowed target keeps the merge unbiased.
+//
+// the lights form one domain: directional lights count as a single point, area lights are sampled the way ray_color
+// jitters its samples over them
+
+// candidates per camera hit, and the nearby reservoirs merged into it and how far away they may be
+static constexpr int kLightCandidates = 8;
+static constexpr int kReuseNeighbors = 5;
+static constexpr int kReuseRadius = 16; // pixels
+
+// the reservoir of the sample pass before counts for at most this many times the candidates of a pass
+static constexpr int kReuseHistory = 20;
+
+struct Reservoir {
+	int light = -1; // directional lights first, then area lights. -1 while empty
+	glm::vec2 uv{0}; // position on an area light, over its width and height
+
+	float weight_sum = 0;
+	float weight = 0; // of the sample in the estimate of the direct light
+	int count = 0; // candidates streamed into the reservoir
+
+	// camera hit the reservoir was made for
+	glm::vec3 position{0};
+	glm::vec3 normal{0};
+};
+
+// reservoir of kLightCandidates light samples for hit, empty if the scene has no lights
+Reservoir sample_lights(const struct HitRecord &hit, const struct Camera &camera, const Scene &scene);
+
+// merges count reservoirs into one for hit. every sample is reweighed by its light at hit
+Reservoir merge_reservoirs(const struct HitRecord &hit, const struct Camera &camera, const Scene &scene,
+						   const Reservoir *const *reservoirs, int count);
+
+// whether the reservoir of other is close enough in depth and normal to be merged into one for hit
+bool similar_surface(const struct HitRecord &hit, const struct Camera &camera, const Reservoir &other);
+
+// direct light at hit from the sample in reservoir, tested with one shadow ray
+glm::vec3 resampled_direct_light(const struct HitRecord &hit, const struct Camera &camera, const Scene &scene,
+								 const Reservoir &reservoir, const struct RenderContext &context, Stats &stats,
+								 int bounce);
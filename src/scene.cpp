@@ -3,6 +3,8 @@
 #include <tuple>
 #include <glm/glm.hpp>
 
+#include "context.h"
+#include "cpu.h"
 #include "ray.h"
 #include "math.h"
 
@@ -28,7 +30,7 @@ std::optional<float> intersect_sphere(const Ray &ray, const Sphere &sphere) {
 	return t0;
 }
 
-std::optional<HitRecord> hit_spheres(const Ray &ray, const Scene &scene, float closest) {
+std::optional<Hit> hit_spheres(const Ray &ray, const Scene &scene, float closest) {
 	int obj_idx = -1;
 	for (auto i = 0; i < scene.spheres.size(); ++i) {
 		auto hit_dst = intersect_sphere(ray, scene.spheres[i]);
@@ -39,22 +41,7 @@ std::optional<HitRecord> hit_spheres(const Ray &ray, const Scene &scene, float c
 	}
 
 	if (obj_idx == -1) return {};
-
-	auto pos = ray_at(ray, closest);
-	auto normal = glm::normalize(pos - scene.spheres[obj_idx].position);
-	auto front_facing = glm::dot(ray.direction, normal) < 0;
-
-	if (!front_facing) normal = -normal;
-
-	return HitRecord{
-			.entity_id = scene.planes[obj_idx].id,
-			.distance = closest,
-			.position = pos,
-			.normal = normal,
-			.tangent = glm::cross(ray.direction, normal),
-			.front_facing = front_facing,
-			.material = &scene.sphere_materials[obj_idx],
-	};
+	return Hit{.distance = closest, .index = obj_idx, .kind = PrimitiveKind::kSphere};
 }
 
 std::optional<float> intersect_plane(const Ray &ray, const Plane &plane) {
@@ -73,7 +60,7 @@ std::optional<float> intersect_plane(const Ray &ray, const Plane &plane) {
 	return t;
 }
 
-std::optional<HitRecord> hit_planes(const Ray &ray, const Scene &scene, float closest) {
+std::optional<Hit> hit_planes(const Ray &ray, const Scene &scene, float closest) {
 	int obj_idx = -1;
 	for (auto i = 0; i < scene.planes.size(); ++i) {
 		auto hit_dst = intersect_plane(ray, scene.planes[i]);
@@ -84,35 +71,87 @@ std::optional<HitRecord> hit_planes(const Ray &ray, const Scene &scene, float cl
 	}
 
 	if (obj_idx == -1) return {};
+	return Hit{.distance = closest, .index = obj_idx, .kind = PrimitiveKind::kPlane};
+}
+
+ISA_KERNEL
+std::optional<Hit> hit_scene(const Ray &ray, const Scene &scene, const RenderContext &context, Stats &stats,
+							 float max_length) {
+	++stats.ray_count;
+
+	auto sphere = hit_spheres(ray, scene, max_length);
+	auto plane = hit_planes(ray, scene, sphere ? sphere->distance : max_length);
+
+	auto closest = plane ? plane : sphere;
+	if (closest && context.touched_entities) {
+		auto id = hit_entity(scene, *closest);
+		context.touched_entities[id / 64] |= std::uint64_t(1) << (id % 64);
+	}
+	return closest;
+}
 
-	const auto &plane = scene.planes[obj_idx];
+EntityId hit_entity(const Scene &scene, const Hit &hit) {
+	switch (hit.kind) {
+	case PrimitiveKind::kSphere:
+		return scene.spheres[hit.index].id;
+	case PrimitiveKind::kPlane:
+		return scene.planes[hit.index].id;
+	}
+	return NULL_ENTITY;
+}
+
+HitRecord surface_attributes(const Ray &ray, const Scene &scene, const Hit &hit) {
+	auto pos = ray_at(ray, hit.distance);
+
+	if (hit.kind == PrimitiveKind::kSphere) {
+		auto normal = glm::normalize(pos - scene.spheres[hit.index].position);
+		auto front_facing = glm::dot(ray.direction, normal) < 0;
+		if (!front_facing) normal = -normal;
+
+		return HitRecord{
+				.entity_id = scene.spheres[hit.index].id,
+				.distance = hit.distance,
+				.position = pos,
+				.normal = normal,
+				.tangent = glm::cross(ray.direction, normal),
+				.front_facing = front_facing,
+				.material = &scene.sphere_materials[hit.index],
+		};
+	}
+
+	const auto &plane = scene.planes[hit.index];
 
-	auto pos = ray_at(ray, closest);
 	auto normal = plane.normal;
 	auto front_facing = glm::dot(ray.direction, normal) < 0;
 	if (!front_facing) normal = -normal;
 
 	return HitRecord{
-			.entity_id = scene.planes[obj_idx].id,
-			.distance = closest,
+			.entity_id = plane.id,
+			.distance = hit.distance,
 			.position = pos,
 			.normal = normal,
 			.tangent = plane.tangent,
 			.front_facing = front_facing,
-			.material = &scene.plane_materials[obj_idx],
+			.material = &scene.plane_materials[hit.index],
 	};
 }
 
-std::optional<HitRecord> hit_scene(const Ray &ray, const Scene &scene, Stats &stats, float max_length) {
-	++stats.ray_count;
-
-	auto sphere = hit_spheres(ray, scene, max_length);
-	auto plane = hit_planes(ray, scene, sphere ? sphere->distance : max_length);
-
-	if (plane) return plane;
-	if (sphere) return sphere;
+void translate_entities(Scene &scene, EntityId first, EntityId last, const glm::vec3 &offset) {
+	auto selected = [first, last](EntityId id) { return id >= first && id <= last; };
+	for (auto &sphere : scene.spheres)
+		if (selected(sphere.id)) sphere.position += offset;
+	for (auto &plane : scene.planes)
+		if (selected(plane.id)) plane.position += offset;
+	for (auto &plane : scene.area_lights)
+		if (selected(plane.id)) plane.position += offset;
+}
 
-	return {};
+Material *entity_material(Scene &scene, EntityId id) {
+	for (auto i = 0; i < scene.spheres.size(); ++i)
+		if (scene.spheres[i].id == id) return &scene.sphere_materials[i];
+	for (auto i = 0; i < scene.planes.size(); ++i)
+		if (scene.planes[i].id == id) return &scene.plane_materials[i];
+	return nullptr;
 }
 
 inline glm::vec3 mat_mul(const glm::mat4 &m, const glm::vec3 &v) {
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <array>
-#include <atomic>
 #include <optional>
 #include <vector>
 
@@ -12,6 +11,7 @@
 #include "light.h"
 #include "material.h"
 #include "math.h"
+#include "stats.h"
 
 using EntityId = unsigned short;
 static const EntityId NULL_ENTITY = 0;
@@ -50,12 +50,34 @@ struct Scene {
 	std::vector<AreaLight> area_light_data;
 };
 
-struct Stats {
-	std::atomic<unsigned int> ray_count = 0;
+enum class PrimitiveKind : unsigned char {
+	kSphere = 0,
+	kPlane,
 };
 
-std::optional<struct HitRecord> hit_scene(const struct Ray &ray, const Scene &scene, Stats &stats,
-										  float max_length = INFINITY);
+// closest intersection of a ray, surface attributes are only evaluated on demand by surface_attributes
+struct Hit {
+	float distance;
+	int index;
+	PrimitiveKind kind;
+};
+
+std::optional<float> intersect_sphere(const struct Ray &ray, const Sphere &sphere);
+
+std::optional<float> intersect_plane(const struct Ray &ray, const Plane &plane);
+
+std::optional<Hit> hit_scene(const struct Ray &ray, const Scene &scene, const struct RenderContext &context,
+							 Stats &stats, float max_length = INFINITY);
+
+EntityId hit_entity(const Scene &scene, const Hit &hit);
+
+struct HitRecord surface_attributes(const struct Ray &ray, const Scene &scene, const Hit &hit);
+
+// moves the spheres and planes with ids first to last, area lights included
+void translate_entities(Scene &scene, EntityId first, EntityId last, const glm::vec3 &offset);
+
+// material of the sphere or plane with id, nullptr if there is none
+Material *entity_material(Scene &scene, EntityId id);
 
 static EntityId add_sphere(Scene &scene, Sphere obj, const Material &material) {
 	obj.id = scene.next_entity_id++;
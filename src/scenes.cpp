@@ -0,0 +1,188 @@
+#include "scenes.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+Camera make_cornell_box_camera() {
+	return Camera{
+			.position = {0, 5, -16},
+			.look_at = {0, 5, 0}, // forward: 0 0 1
+
+			.vfov = 50.0,
+			.focal_length = 1.f,
+	};
+}
+
+// walls and boxes of the cornell box, without a light
+static void add_cornell_room(Scene &scene) {
+	// floor
+	add_plane(scene, make_mat_lambert({1, 1, 1}), make_rect(
+			{0, 0, 0},
+			{0, 1, 0},
+			{1, 0, 0},
+			{10, 10}
+	));
+	// back
+	add_plane(scene, make_mat_lambert({1, 1, 1}), make_rect(
+			{0, 5, 5},
+			{0, 0, -1},
+			{1, 0, 0},
+			{10, 10}
+	));
+	// ceiling
+	add_plane(scene, make_mat_lambert({1, 1, 1}), make_rect(
+			{0, 10, 0},
+			{0, -1, 0},
+			{-1, 0, 0},
+			{10, 10}
+	));
+	// left
+	add_plane(scene, make_mat_lambert({1, 0, 0}), make_rect(
+			{-5, 5, 0},
+			{1, 0, 0},
+			{0, -1, 0},
+			{10, 10}
+	));
+	// right
+	add_plane(scene, make_mat_lambert({0, 1, 0}), make_rect(
+			{5, 5, 0},
+			{-1, 0, 0},
+			{0, 1, 0},
+			{10, 10}
+	));
+
+	auto box_material = Material{
+			.type = MaterialType::kBlinnPhong,
+			.color = {1, 1, 1},
+			.blinnPhong = {
+					.diffuse_intensity = 1.f,
+					.specular_intensity = 1.f,
+			},
+	};
+	// left
+	add_planes(scene, box_material, make_box(
+			{-2, 3, 2},
+			{3, 6, 3},
+			glm::rotate(glm::mat4(1.f), glm::radians(-25.f), {0, 1, 0})
+	));
+	// right
+	add_planes(scene, box_material, make_box(
+			{1.5, 1.5, -2},
+			{3, 3, 3},
+			glm::rotate(glm::mat4(1.f), glm::radians(20.f), {0, 1, 0})
+	));
+}
+
+void make_cornell_box(Scene &scene) {
+	add_cornell_room(scene);
+
+	// light
+	auto area_light = AreaLight{
+			.color = {1, 1, 1},
+			.intensity = 1.f,
+			.u_samples = 3,
+			.v_samples = 3,
+			.max_random_offset = .3f,
+	};
+	add_area_light(scene, area_light, make_rect(
+			{0, 9.9999f, 0},
+			{0, -1, 0},
+			{0, 0, 1},
+			{1, 1}
+	));
+}
+
+void make_light_grid(Scene &scene) {
+	add_cornell_room(scene);
+
+	// as much light as the single one of the cornell box, spread over 16 colored lights
+	const glm::vec3 colors[] = {{1, .6f, .3f}, {.3f, .6f, 1}, {1, 1, 1}, {.6f, 1, .5f}};
+	for (auto x = 0; x < 4; ++x) {
+		for (auto z = 0; z < 4; ++z) {
+			auto area_light = AreaLight{
+					.color = colors[(x + z) % 4],
+					.intensity = 1.f / 16.f,
+					.u_samples = 2,
+					.v_samples = 2,
+					.max_random_offset = .3f,
+			};
+			add_area_light(scene, area_light, make_rect(
+					{x * 2.5f - 3.75f, 9.9999f, z * 2.5f - 3.75f},
+					{0, -1, 0},
+					{0, 0, 1},
+					{.5f, .5f}
+			));
+		}
+	}
+}
+
+Camera make_sphere_field_camera() {
+	return Camera{
+			.position = {0, 4, -14},
+			.look_at = {0, 1, 0},
+
+			.vfov = 45.0,
+			.focal_length = 1.f,
+	};
+}
+
+void make_sphere_field(Scene &scene) {
+	// ground
+	add_plane(scene, make_mat_lambert({.8f, .8f, .8f}), make_rect(
+			{0, 0, 0},
+			{0, 1, 0},
+			{1, 0, 0},
+			{40, 40}
+	));
+
+	auto shiny_material = Material{
+			.type = MaterialType::kBlinnPhong,
+			.color = {.9f, .6f, .2f},
+			.blinnPhong = {
+					.diffuse_intensity = 1.f,
+					.specular_intensity = .5f,
+					.shininess = 32.f,
+			},
+	};
+	for (auto x = -3; x <= 3; ++x) {
+		for (auto z = -1; z <= 2; ++z) {
+			auto material = (x + z) % 2 == 0 ? shiny_material : make_mat_lambert({.3f, .5f, .9f});
+			add_sphere(scene, Sphere{.position = {x * 2.2f, 1, z * 2.2f}, .radius = 1}, material);
+		}
+	}
+
+	scene.directional_lights.push_back(DirectionalLight{
+			.direction = glm::normalize(glm::vec3(-1, -2, 1)),
+			.color = {1, 1, .9f},
+			.intensity = .8f,
+	});
+
+	auto area_light = AreaLight{
+			.color = {1, 1, 1},
+			.intensity = .5f,
+			.u_samples = 2,
+			.v_samples = 2,
+			.max_random_offset = .3f,
+	};
+	add_area_light(scene, area_light, make_rect(
+			{0, 8, -2},
+			{0, -1, 0},
+			{0, 0, 1},
+			{4, 4}
+	));
+}
+
+const std::vector<SceneEntry> &standard_scenes() {
+	static const std::vector<SceneEntry> scenes = {
+			{"cornell_box", make_cornell_box, make_cornell_box_camera},
+			{"light_grid", make_light_grid, make_cornell_box_camera},
+			{"sphere_field", make_sphere_field, make_sphere_field_camera},
+	};
+	return scenes;
+}
+
+const SceneEntry *find_scene(const std::string &name) {
+	for (const auto &entry : standard_scenes())
+		if (name == entry.name) return &entry;
+	return nullptr;
+}
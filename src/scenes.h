@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "scene.h"
+
+// camera looking into the cornell box, init_camera still has to be called with the image size
+Camera make_cornell_box_camera();
+
+// cornell style box with two blinn phong boxes lit by a small area light in the ceiling
+void make_cornell_box(Scene &scene);
+
+// the cornell box lit by a grid of 16 small colored area lights instead
+void make_light_grid(Scene &scene);
+
+Camera make_sphere_field_camera();
+
+// grid of diffuse and glossy spheres on a ground plane, lit by the sun and a large area light
+void make_sphere_field(Scene &scene);
+
+struct SceneEntry {
+	const char *name;
+	void (*make_scene)(Scene &scene);
+	Camera (*make_camera)();
+};
+
+// scenes that can be selected by name, e.g. by the benchmarks
+const std::vector<SceneEntry> &standard_scenes();
+
+const SceneEntry *find_scene(const std::string &name);
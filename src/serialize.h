@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+// length prefixed vectors of trivially copyable values, for the binary files the renderer keeps between runs
+
+// a length asking for more than this is taken for a broken file rather than allocated
+static constexpr std::uint64_t kMaxVectorBytes = std::uint64_t(1) << 36;
+
+template<typename T>
+void write_vector(std::ostream &out, const std::vector<T> &v) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	auto size = static_cast<std::uint64_t>(v.size());
+	out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+	out.write(reinterpret_cast<const char *>(v.data()), static_cast<std::streamsize>(v.size() * sizeof(T)));
+}
+
+template<typename T>
+bool read_vector(std::istream &in, std::vector<T> &v) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	std::uint64_t size;
+	if (!in.read(reinterpret_cast<char *>(&size), sizeof(size)) || size > kMaxVectorBytes / sizeof(T)) return false;
+	v.resize(size);
+	auto bytes = static_cast<std::streamsize>(size * sizeof(T));
+	return static_cast<bool>(in.read(reinterpret_cast<char *>(v.data()), bytes));
+}
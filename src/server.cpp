@@ -0,0 +1,344 @@
+#include "server.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "render.h"
+#include "scenes.h"
+#include "stream_io.h"
+
+using Clock = std::chrono::steady_clock;
+
+// interactive requests want their first pixels quickly, so they default to smaller tiles than batch renders
+static constexpr int kDefaultTileSize = 32;
+
+struct ServerJob {
+	Config cfg;
+	Camera cam;
+	const Scene &scene;
+	int priority;
+
+	std::vector<char> pixels;
+	RenderingTask task;
+
+	std::atomic<bool> cancelled = false;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<glm::ivec4> finished;
+	int remaining = 0;
+	int tiles_filled = 0;
+	Stats stats;
+
+	ServerJob(const Config &cfg, const Camera &cam, const Scene &scene, int priority)
+			: cfg(cfg), cam(cam), scene(scene), priority(priority), pixels(cfg.width * cfg.height * 3),
+			  task{.cfg = this->cfg, .cam = this->cam, .scene = scene, .pixel_buffer = pixels.data()} {
+		task.ray_color = select_ray_color(scene, this->cfg);
+	}
+};
+
+struct TileWork {
+	int priority;
+	std::uint64_t sequence;
+	std::shared_ptr<ServerJob> job;
+	glm::ivec4 rect;
+};
+
+// highest priority first, requests of the same priority in the order they arrived
+struct TileWorkOrder {
+	bool operator()(const TileWork &a, const TileWork &b) const {
+		if (a.priority != b.priority) return a.priority < b.priority;
+		return a.sequence > b.sequence;
+	}
+};
+
+struct RenderServer {
+	Config defaults;
+
+	std::mutex scenes_mutex;
+	std::map<std::string, std::unique_ptr<Scene>> scenes;
+
+	std::mutex work_mutex;
+	std::condition_variable work_ready;
+	std::priority_queue<TileWork, std::vector<TileWork>, TileWorkOrder> work;
+	std::uint64_t next_sequence = 0;
+	bool stopping = false;
+
+	int listen_fd = -1;
+	std::atomic<bool> shutdown_requested = false;
+
+	std::mutex connections_mutex;
+	std::condition_variable connections_closed;
+	std::vector<int> connection_fds;
+};
+
+static const Scene *resident_scene(RenderServer &server, const std::string &id) {
+	const std::lock_guard guard(server.scenes_mutex);
+
+	auto it = server.scenes.find(id);
+	if (it != server.scenes.end()) return it->second.get();
+
+	auto entry = find_scene(id);
+	if (!entry) return nullptr;
+
+	auto scene = std::make_unique<Scene>();
+	entry->make_scene(*scene);
+	return server.scenes.emplace(id, std::move(scene)).first->second.get();
+}
+
+static void worker_loop(RenderServer &server) {
+	while (true) {
+		TileWork item;
+		{
+			std::unique_lock lock(server.work_mutex);
+			server.work_ready.wait(lock, [&server]() { return !server.work.empty() || server.stopping; });
+			if (server.work.empty()) return;
+
+			item = server.work.top();
+			server.work.pop();
+		}
+
+		auto &job = *item.job;
+		Stats stats;
+		auto filled = false;
+		if (!job.cancelled) {
+			auto first_missing = item.rect.y;
+			if (Clock::now() < job.task.deadline)
+				first_missing = render_tile(job.task, item.rect, job.task.context, stats);
+			if (first_missing < item.rect.w) {
+				fill_tile(job.task, item.rect, first_missing, job.task.context, stats);
+				filled = true;
+			}
+		}
+
+		{
+			const std::lock_guard guard(job.mutex);
+			job.stats.merge(stats);
+			job.tiles_filled += filled;
+			--job.remaining;
+			if (!job.cancelled) job.finished.push_back(item.rect);
+		}
+		job.changed.notify_one();
+	}
+}
+
+static bool parse_vec3(const std::string &value, glm::vec3 &out) {
+	return std::sscanf(value.c_str(), "%f,%f,%f", &out.x, &out.y, &out.z) == 3;
+}
+
+static std::string handle_render(RenderServer &server, int fd, std::istringstream &args) {
+	auto cfg = server.defaults;
+	cfg.tile_size = kDefaultTileSize;
+	auto priority = 0;
+	std::string scene_id;
+	std::optional<glm::vec3> position;
+	std::optional<glm::vec3> look_at;
+	std::optional<float> fov;
+	std::optional<int> deadline_ms;
+
+	std::string arg;
+	while (args >> arg) {
+		auto split = arg.find('=');
+		if (split == std::string::npos) return "expected key=value, got " + arg;
+		auto key = arg.substr(0, split);
+		auto value = arg.substr(split + 1);
+
+		try {
+			if (key == "scene") scene_id = value;
+			else if (key == "width") cfg.width = std::stoi(value);
+			else if (key == "height") cfg.height = std::stoi(value);
+			else if (key == "samples") cfg.samples_base = std::stoi(value);
+			else if (key == "depth") cfg.max_depth = std::stoi(value);
+			else if (key == "ao") cfg.ambient_occlusion_samples = std::stoi(value);
+			else if (key == "tile") cfg.tile_size = std::stoi(value);
+			else if (key == "priority") priority = std::stoi(value);
+			else if (key == "fov") fov = std::stof(value);
+			else if (key == "deadline") deadline_ms = std::stoi(value);
+			else if (key == "position" || key == "look_at") {
+				glm::vec3 v;
+				if (!parse_vec3(value, v)) return "expected x,y,z for " + key;
+				(key == "position" ? position : look_at) = v;
+			} else return "unknown option " + key;
+		} catch (const std::exception &) {
+			return "invalid value for " + key;
+		}
+	}
+
+	if (cfg.width <= 0 || cfg.height <= 0 || cfg.samples_base <= 0 || cfg.tile_size <= 0)
+		return "width, height, samples and tile have to be positive";
+
+	auto entry = find_scene(scene_id);
+	auto scene = resident_scene(server, scene_id);
+	if (!entry || !scene) return "unknown scene " + scene_id;
+
+	auto cam = entry->make_camera();
+	if (position) cam.position = *position;
+	if (look_at) cam.look_at = *look_at;
+	if (fov) cam.vfov = *fov;
+	init_camera(cam, cfg.width, cfg.height);
+
+	auto start = Clock::now();
+	auto job = std::make_shared<ServerJob>(cfg, cam, *scene, priority);
+	if (deadline_ms) job->task.deadline = start + std::chrono::milliseconds(*deadline_ms);
+	auto tiles = image_tiles(cfg);
+	job->remaining = static_cast<int>(tiles.size());
+	{
+		const std::lock_guard guard(server.work_mutex);
+		for (const auto &rect : tiles)
+			server.work.push(
+					TileWork{.priority = priority, .sequence = server.next_sequence++, .job = job, .rect = rect});
+	}
+	server.work_ready.notify_all();
+
+	auto connected = true;
+	while (true) {
+		glm::ivec4 rect;
+		{
+			std::unique_lock lock(job->mutex);
+			job->changed.wait(lock, [&job]() { return !job->finished.empty() || job->remaining == 0; });
+			if (job->finished.empty()) break;
+			rect = job->finished.front();
+			job->finished.pop_front();
+		}
+
+		// stream the tile in image space, the pixel buffer stores rows top to bottom
+		auto x = rect.x;
+		auto y = cfg.height - rect.w;
+		auto w = rect.z - rect.x;
+		auto h = rect.w - rect.y;
+		connected = write_line(fd, "tile " + std::to_string(x) + " " + std::to_string(y) + " " +
+								   std::to_string(w) + " " + std::to_string(h) + "\n");
+		for (auto row = 0; connected && row < h; ++row)
+			connected = write_all(fd, job->pixels.data() + ((y + row) * cfg.width + x) * 3, w * 3);
+
+		if (!connected) {
+			// nobody is listening anymore, the workers skip what is left of this request
+			job->cancelled = true;
+			return {};
+		}
+	}
+
+	auto ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	std::cout << "rendered " << scene_id << " " << cfg.width << "x" << cfg.height << " priority " << priority
+			  << " in " << ms << "ms" << std::endl;
+	write_line(fd, "done " + std::to_string(ms) + " " + std::to_string(job->stats.ray_count) + " " +
+					   std::to_string(job->tiles_filled) + "\n");
+	return {};
+}
+
+static void serve_connection(RenderServer &server, int fd) {
+	LineReader reader{.fd = fd};
+	std::string line;
+
+	while (reader.read_line(line)) {
+		std::istringstream args(line);
+		std::string command;
+		args >> command;
+
+		std::string error;
+		if (command == "scenes") {
+			std::string answer = "scenes";
+			for (const auto &entry : standard_scenes()) answer += std::string(" ") + entry.name;
+			write_line(fd, answer + "\n");
+		} else if (command == "load") {
+			std::string id;
+			args >> id;
+			if (resident_scene(server, id)) write_line(fd, "ok\n");
+			else error = "unknown scene " + id;
+		} else if (command == "render") {
+			error = handle_render(server, fd, args);
+		} else if (command == "shutdown") {
+			write_line(fd, "ok\n");
+			server.shutdown_requested = true;
+			::shutdown(server.listen_fd, SHUT_RDWR);
+			break;
+		} else if (!command.empty()) {
+			error = "unknown command " + command;
+		}
+
+		if (!error.empty() && !write_line(fd, "error " + error + "\n")) break;
+	}
+
+	{
+		const std::lock_guard guard(server.connections_mutex);
+		std::erase(server.connection_fds, fd);
+		close(fd);
+		// under the lock, run_render_server may return and destroy server as soon as it is released
+		server.connections_closed.notify_all();
+	}
+}
+
+int run_render_server(const std::string &socket_path, const Config &defaults) {
+	RenderServer server{.defaults = defaults};
+
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path)) {
+		std::cerr << "socket path too long: " << socket_path << std::endl;
+		return 1;
+	}
+	std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+	server.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(socket_path.c_str());
+	if (server.listen_fd < 0 || bind(server.listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+		listen(server.listen_fd, 16) < 0) {
+		std::cerr << "failed to listen on " << socket_path << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	std::vector<std::thread> workers;
+	for (auto i = 0; i < render_thread_count(defaults); ++i)
+		workers.emplace_back([&server]() { worker_loop(server); });
+
+	std::cout << "listening on " << socket_path << " with " << workers.size() << " render threads" << std::endl;
+
+	while (!server.shutdown_requested) {
+		auto fd = accept(server.listen_fd, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+
+		{
+			const std::lock_guard guard(server.connections_mutex);
+			server.connection_fds.push_back(fd);
+		}
+		std::thread([&server, fd]() { serve_connection(server, fd); }).detach();
+	}
+
+	// unblock clients that are idle on their connection, running renders still stream their last tiles
+	{
+		std::unique_lock lock(server.connections_mutex);
+		for (auto fd : server.connection_fds) ::shutdown(fd, SHUT_RD);
+		server.connections_closed.wait(lock, [&server]() { return server.connection_fds.empty(); });
+	}
+
+	{
+		const std::lock_guard guard(server.work_mutex);
+		server.stopping = true;
+	}
+	server.work_ready.notify_all();
+	for (auto &t : workers) t.join();
+
+	close(server.listen_fd);
+	unlink(socket_path.c_str());
+	return 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "config.h"
+
+// long running render daemon on a unix domain socket. scenes stay resident once loaded and every request is split
+// into tiles that share one worker pool, higher priority requests take over the workers at the next tile.
+//
+// requests are single text lines, answers are text lines followed by raw pixel data:
+//   scenes                      -> "scenes <id> <id> ...\n"
+//   load <scene id>             -> "ok\n", builds the scene ahead of the first render
+//   render scene=<id> [width=n] [height=n] [samples=n] [depth=n] [ao=n] [tile=n] [priority=n]
+//          [position=x,y,z] [look_at=x,y,z] [fov=degrees] [deadline=ms]
+//                               -> "tile <x> <y> <w> <h>\n" followed by w * h rgb bytes (rows top to bottom) for
+//                                  every tile as it finishes, then "done <ms> <rays> <filled tiles>\n". what is
+//                                  left of the frame at the deadline is filled at one sample per pixel
+//   shutdown                    -> "ok\n", finishes running requests and exits
+// any failure is answered with "error <message>\n". omitted render options fall back to defaults.
+int run_render_server(const std::string &socket_path, const Config &defaults);
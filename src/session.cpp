@@ -0,0 +1,103 @@
+#include "session.h"
+
+#include <algorithm>
+
+#include "render.h"
+
+RenderSession::RenderSession(Scene scene, Camera camera, Config cfg, TileCallback on_tile)
+		: scene(std::move(scene)), camera(camera), cfg(cfg), on_tile(std::move(on_tile)),
+		  pixels(cfg.width * cfg.height * 3), colors(cfg.width * cfg.height),
+		  future(promise.get_future().share()) {
+	init_camera(this->camera, cfg.width, cfg.height);
+	thread = std::thread([this]() { run(); });
+}
+
+RenderSession::~RenderSession() {
+	cancel();
+	if (thread.joinable()) thread.join();
+}
+
+void RenderSession::cancel() {
+	stop.request_stop();
+}
+
+std::optional<TileResult> RenderSession::next_tile() {
+	std::unique_lock lock(tiles_mutex);
+	tiles_ready.wait(lock, [this]() { return !tiles.empty() || finished; });
+	if (tiles.empty()) return {};
+
+	auto tile = std::move(tiles.front());
+	tiles.pop_front();
+	return tile;
+}
+
+std::shared_future<RenderResult> RenderSession::result() const {
+	return future;
+}
+
+TileResult RenderSession::copy_tile(const glm::ivec4 &rect) const {
+	auto tile = TileResult{
+			.x = rect.x,
+			.y = cfg.height - rect.w,
+			.width = rect.z - rect.x,
+			.height = rect.w - rect.y,
+	};
+	tile.pixels.resize(tile.width * tile.height * 3);
+	tile.colors.resize(tile.width * tile.height);
+
+	for (auto row = 0; row < tile.height; ++row) {
+		auto offset = (tile.y + row) * cfg.width + tile.x;
+		std::copy_n(pixels.begin() + offset * 3, tile.width * 3, tile.pixels.begin() + row * tile.width * 3);
+		std::copy_n(colors.begin() + offset, tile.width, tile.colors.begin() + row * tile.width);
+	}
+	return tile;
+}
+
+void RenderSession::tile_done(const glm::ivec4 &rect) {
+	auto tile = copy_tile(rect);
+	if (on_tile) {
+		on_tile(tile);
+		return;
+	}
+
+	{
+		const std::lock_guard guard(tiles_mutex);
+		tiles.push_back(std::move(tile));
+	}
+	tiles_ready.notify_one();
+}
+
+void RenderSession::run() {
+	RenderingTask task{
+			.cfg = cfg,
+			.cam = camera,
+			.scene = scene,
+
+			.pixel_buffer = pixels.data(),
+			.color_buffer = colors.data(),
+
+			.stop_token = stop.get_token(),
+			.on_tile_done = [this](const glm::ivec4 &rect) { tile_done(rect); },
+			// the tiles of a bidirectional frame are only done together with the frame
+			.on_frame_done = [this]() {
+				if (cfg.integrator != Integrator::kBidirectional || stop.stop_requested()) return;
+				for (const auto &rect : image_tiles(cfg)) tile_done(rect);
+			},
+	};
+	generate_image(task);
+
+	{
+		const std::lock_guard guard(tiles_mutex);
+		finished = true;
+	}
+	tiles_ready.notify_all();
+
+	promise.set_value(RenderResult{
+			.width = cfg.width,
+			.height = cfg.height,
+			.pixels = pixels,
+			.stats = task.stats,
+			.duration_ms = task.duration_ms,
+			.cancelled = !task.rectangles.empty(),
+	});
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "camera.h"
+#include "config.h"
+#include "scene.h"
+
+// a finished tile in image space, x and y are the top left corner and rows run top to bottom
+struct TileResult {
+	int x;
+	int y;
+	int width;
+	int height;
+
+	std::vector<char> pixels; // 8 bit rgb
+	std::vector<glm::vec3> colors; // linear rgb before tone mapping
+};
+
+struct RenderResult {
+	int width;
+	int height;
+
+	std::vector<char> pixels; // 8 bit rgb, top row first like stbi_write_bmp expects
+
+	Stats stats;
+	double duration_ms;
+	bool cancelled;
+};
+
+using TileCallback = std::function<void(const TileResult &tile)>;
+
+// renders its own copy of a scene in the background, the session object is the handle to cancel or wait for it.
+// finished tiles are passed to on_tile from the render thread that finished them, without a callback they are
+// queued for next_tile instead.
+struct RenderSession {
+	RenderSession(Scene scene, Camera camera, Config cfg, TileCallback on_tile = {});
+	// cancels the render and waits for the render threads
+	~RenderSession();
+
+	RenderSession(const RenderSession &) = delete;
+	RenderSession &operator=(const RenderSession &) = delete;
+
+	// remaining tiles are skipped, tiles already being rendered still complete
+	void cancel();
+
+	// blocks until the next tile is finished, empty once the render is over and every tile was pulled
+	std::optional<TileResult> next_tile();
+
+	std::shared_future<RenderResult> result() const;
+
+private:
+	void run();
+	TileResult copy_tile(const glm::ivec4 &rect) const;
+	void tile_done(const glm::ivec4 &rect);
+
+	Scene scene;
+	Camera camera;
+	Config cfg;
+	TileCallback on_tile;
+
+	std::vector<char> pixels;
+	std::vector<glm::vec3> colors;
+
+	std::stop_source stop;
+
+	std::mutex tiles_mutex;
+	std::condition_variable tiles_ready;
+	std::deque<TileResult> tiles;
+	bool finished = false;
+
+	std::promise<RenderResult> promise;
+	std::shared_future<RenderResult> future;
+
+	std::thread thread;
+};
@@ -0,0 +1,57 @@
+#include "stats.h"
+
+#include <iomanip>
+
+void Stats::merge(const Stats &other) {
+	ray_count += other.ray_count;
+	for (auto i = 0; i < path_length.size(); ++i) path_length[i] += other.path_length[i];
+	for (auto i = 0; i < kStatsMaxBounces; ++i) {
+		shadow_rays[i] += other.shadow_rays[i];
+		shadow_hits[i] += other.shadow_hits[i];
+		ao_rays[i] += other.ao_rays[i];
+		ao_hits[i] += other.ao_hits[i];
+	}
+	irradiance_lookups += other.irradiance_lookups;
+	irradiance_records += other.irradiance_records;
+	ao_cache_lookups += other.ao_cache_lookups;
+	ao_cache_hits += other.ao_cache_hits;
+	lightmap_hits += other.lightmap_hits;
+}
+
+static double rate(std::uint64_t hits, std::uint64_t rays) {
+	return rays > 0 ? static_cast<double>(hits) / static_cast<double>(rays) : 0.0;
+}
+
+void print_stats(std::ostream &out, const Stats &stats) {
+	std::uint64_t paths = 0;
+	for (auto n : stats.path_length) paths += n;
+
+	out << "bounce  paths ended  shadow rays  shadow hit  ao rays      ao hit" << std::endl;
+	for (auto i = 0; i < kStatsMaxBounces; ++i) {
+		auto ended = stats.path_length[i + 1];
+		if (ended == 0 && stats.shadow_rays[i] == 0 && stats.ao_rays[i] == 0) continue;
+
+		out << std::setw(6) << i << "  "
+			<< std::setw(11) << ended << "  "
+			<< std::setw(11) << stats.shadow_rays[i] << "  "
+			<< std::setw(9) << std::fixed << std::setprecision(1)
+			<< rate(stats.shadow_hits[i], stats.shadow_rays[i]) * 100 << "%  "
+			<< std::setw(11) << stats.ao_rays[i] << "  "
+			<< std::setw(5) << rate(stats.ao_hits[i], stats.ao_rays[i]) * 100 << "%" << std::endl;
+	}
+
+	auto segments = 0.0;
+	for (auto i = 0; i < stats.path_length.size(); ++i) segments += static_cast<double>(i * stats.path_length[i]);
+	out << "mean path length: " << std::setprecision(2) << (paths > 0 ? segments / paths : 0.0) << std::endl;
+	if (stats.irradiance_lookups > 0) {
+		out << "irradiance cache: " << stats.irradiance_records << " records for " << stats.irradiance_lookups
+			<< " lookups, " << rate(stats.irradiance_lookups - stats.irradiance_records, stats.irradiance_lookups) * 100
+			<< "% interpolated" << std::endl;
+	}
+	if (stats.ao_cache_lookups > 0) {
+		out << "ao cache: " << stats.ao_cache_hits << " of " << stats.ao_cache_lookups << " lookups answered, "
+			<< rate(stats.ao_cache_hits, stats.ao_cache_lookups) * 100 << "%" << std::endl;
+	}
+	if (stats.lightmap_hits > 0) out << "lightmaps: " << stats.lightmap_hits << " hits shaded" << std::endl;
+	out.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+
+// histograms keep the first bounces separate and fold deeper ones into the last bucket
+static constexpr int kStatsMaxBounces = 16;
+
+// counters are plain integers, every render thread fills its own Stats and they are merged after the frame
+struct Stats {
+	std::uint64_t ray_count = 0;
+
+	// number of camera paths that ended after n segments
+	std::array<std::uint64_t, kStatsMaxBounces + 1> path_length{};
+
+	// rays traced and rays that hit something, per bounce
+	std::array<std::uint64_t, kStatsMaxBounces> shadow_rays{};
+	std::array<std::uint64_t, kStatsMaxBounces> shadow_hits{};
+	std::array<std::uint64_t, kStatsMaxBounces> ao_rays{};
+	std::array<std::uint64_t, kStatsMaxBounces> ao_hits{};
+
+	// first bounce lookups in the irradiance cache, and the ones that had to sample a new record
+	std::uint64_t irradiance_lookups = 0;
+	std::uint64_t irradiance_records = 0;
+
+	// ambient occlusion cache lookups, and the ones answered from the cache without tracing
+	std::uint64_t ao_cache_lookups = 0;
+	std::uint64_t ao_cache_hits = 0;
+
+	// hits shaded from a lightmap instead of traced
+	std::uint64_t lightmap_hits = 0;
+
+	void merge(const Stats &other);
+};
+
+// prints the path length, shadow and ambient occlusion histograms
+void print_stats(std::ostream &out, const Stats &stats);
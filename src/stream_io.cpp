@@ -0,0 +1,59 @@
+#include "stream_io.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool write_all(int fd, const char *data, std::size_t size) {
+	while (size > 0) {
+		// send does not raise SIGPIPE when the other side is gone, plain pipes fall back to write
+		auto written = send(fd, data, size, MSG_NOSIGNAL);
+		if (written < 0 && errno == ENOTSOCK) written = write(fd, data, size);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool write_line(int fd, const std::string &line) {
+	return write_all(fd, line.data(), line.size());
+}
+
+bool LineReader::read_line(std::string &line) {
+	while (true) {
+		auto end = buffer.find('\n');
+		if (end != std::string::npos) {
+			line = buffer.substr(0, end);
+			buffer.erase(0, end + 1);
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			return true;
+		}
+
+		char chunk[4096];
+		auto count = read(fd, chunk, sizeof(chunk));
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) return false;
+		buffer.append(chunk, count);
+	}
+}
+
+bool LineReader::read_bytes(char *out, std::size_t size) {
+	auto buffered = std::min(size, buffer.size());
+	std::copy_n(buffer.begin(), buffered, out);
+	buffer.erase(0, buffered);
+	out += buffered;
+	size -= buffered;
+
+	while (size > 0) {
+		auto count = read(fd, out, size);
+		if (count < 0 && errno == EINTR) continue;
+		if (count <= 0) return false;
+		out += count;
+		size -= count;
+	}
+	return true;
+}
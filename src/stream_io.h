@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// blocking helpers for the line based protocols spoken over sockets and pipes
+
+bool write_all(int fd, const char *data, std::size_t size);
+
+bool write_line(int fd, const std::string &line);
+
+// buffers reads so text lines and the raw payloads following them can be mixed on one stream
+struct LineReader {
+	int fd;
+	std::string buffer;
+
+	// strips the line ending, false once the stream is closed
+	bool read_line(std::string &line);
+
+	bool read_bytes(char *out, std::size_t size);
+};
@@ -0,0 +1,116 @@
+#include "trace.h"
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct TraceEvent {
+	const char *name;
+	const char *category;
+	Clock::time_point start;
+	Clock::time_point end;
+	int rect[4];
+	bool has_rect;
+};
+
+struct ThreadTrace {
+	int tid;
+	std::string name;
+	std::vector<TraceEvent> events;
+};
+
+static std::atomic<bool> enabled = false;
+static Clock::time_point epoch;
+
+// only touched when a thread records its first event and when writing the trace
+static std::mutex registry_mutex;
+static std::vector<std::unique_ptr<ThreadTrace>> registry;
+
+static thread_local ThreadTrace *local_trace = nullptr;
+
+static ThreadTrace &thread_trace() {
+	if (!local_trace) {
+		const std::lock_guard guard(registry_mutex);
+		auto tid = static_cast<int>(registry.size()) + 1;
+		auto name = "thread " + std::to_string(tid);
+		registry.push_back(std::make_unique<ThreadTrace>(ThreadTrace{.tid = tid, .name = name}));
+		local_trace = registry.back().get();
+		local_trace->events.reserve(1024);
+	}
+	return *local_trace;
+}
+
+void trace_enable() {
+	epoch = Clock::now();
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+bool trace_enabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void trace_thread_name(const std::string &name) {
+	if (trace_enabled()) thread_trace().name = name;
+}
+
+TraceScope::TraceScope(const char *name, const char *category)
+		: name(name), category(category), rect{}, has_rect(false) {
+	if (trace_enabled()) start = Clock::now();
+}
+
+TraceScope::TraceScope(const char *name, const char *category, int x0, int y0, int x1, int y1)
+		: name(name), category(category), rect{x0, y0, x1, y1}, has_rect(true) {
+	if (trace_enabled()) start = Clock::now();
+}
+
+TraceScope::~TraceScope() {
+	if (!trace_enabled()) return;
+
+	thread_trace().events.push_back(TraceEvent{
+			.name = name,
+			.category = category,
+			.start = start,
+			.end = Clock::now(),
+			.rect = {rect[0], rect[1], rect[2], rect[3]},
+			.has_rect = has_rect,
+	});
+}
+
+static double to_us(Clock::time_point t) {
+	return std::chrono::duration<double, std::micro>(t - epoch).count();
+}
+
+bool trace_write(const std::string &path) {
+	std::ofstream out(path);
+	if (!out) return false;
+
+	const std::lock_guard guard(registry_mutex);
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\": [\n";
+	auto first = true;
+	for (const auto &thread : registry) {
+		out << (first ? "" : ",\n") << R"({"name": "thread_name", "ph": "M", "pid": 1, "tid": )" << thread->tid
+			<< R"(, "args": {"name": ")" << thread->name << "\"}}";
+		first = false;
+
+		for (const auto &e : thread->events) {
+			out << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"" << e.category << "\", \"ph\": \"X\""
+				<< ", \"ts\": " << to_us(e.start) << ", \"dur\": " << to_us(e.end) - to_us(e.start)
+				<< ", \"pid\": 1, \"tid\": " << thread->tid;
+			if (e.has_rect) {
+				out << ", \"args\": {\"x0\": " << e.rect[0] << ", \"y0\": " << e.rect[1]
+					<< ", \"x1\": " << e.rect[2] << ", \"y1\": " << e.rect[3] << "}";
+			}
+			out << "}";
+		}
+	}
+	out << "\n]}\n";
+
+	return static_cast<bool>(out);
+}
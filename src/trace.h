@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// opt-in timeline of scoped events, every thread records into its own buffer so the hot path takes no locks.
+// the buffers are written as chrome trace-event json once the render threads are joined.
+
+void trace_enable();
+
+bool trace_enabled();
+
+// label shown for the calling thread in the timeline viewer
+void trace_thread_name(const std::string &name);
+
+bool trace_write(const std::string &path);
+
+struct TraceScope {
+	const char *name;
+	const char *category;
+	int rect[4];
+	bool has_rect;
+	std::chrono::steady_clock::time_point start;
+
+	TraceScope(const char *name, const char *category);
+	// tile scopes carry the tile rectangle (x0, y0, x1, y1) as event args
+	TraceScope(const char *name, const char *category, int x0, int y0, int x1, int y1);
+	~TraceScope();
+
+	TraceScope(const TraceScope &) = delete;
+	TraceScope &operator=(const TraceScope &) = delete;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,273 @@
+#include "tuning.h"
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "cpu.h"
+#include "render.h"
+
+static constexpr int kTileSizes[] = {16, 32, 48, 64, 100, 128};
+static constexpr int kAmbientOcclusionSamples[] = {1, 2, 4, 5, 8};
+static constexpr int kAreaLightSamples[] = {1, 2, 3, 4};
+
+// equal error search renders are this small, the reference takes most of the tuning time
+static constexpr int kCalibrationSize = 128;
+static constexpr int kReferenceSamplesBase = 8;
+static constexpr int kReferenceAmbientOcclusionSamples = 16;
+static constexpr int kReferenceAreaLightSamples = 4;
+
+std::string default_tuning_path(const std::string &scene) {
+	return scene + ".tune";
+}
+
+bool load_tuning_profile(const std::string &path, TuningProfile &profile) {
+	std::ifstream in(path);
+	if (!in) return false;
+
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream args(line);
+		std::string key;
+		if (!(args >> key)) continue;
+
+		std::string value;
+		std::getline(args >> std::ws, value);
+
+		try {
+			if (key == "scene") profile.scene = value;
+			else if (key == "isa") profile.isa = value;
+			else if (key == "hardware_threads") profile.hardware_threads = std::stoi(value);
+			else if (key == "width") profile.width = std::stoi(value);
+			else if (key == "height") profile.height = std::stoi(value);
+			else if (key == "tile_size") profile.tile_size = std::stoi(value);
+			else if (key == "threads") profile.threads = std::stoi(value);
+			else if (key == "samples_base") profile.samples_base = std::stoi(value);
+			else if (key == "ambient_occlusion_samples") profile.ambient_occlusion_samples = std::stoi(value);
+			else if (key == "area_light_samples") profile.area_light_samples = std::stoi(value);
+		} catch (const std::exception &) {
+			return false;
+		}
+	}
+
+	profile.has_sample_split = profile.samples_base > 0;
+	return profile.tile_size > 0 && profile.threads > 0;
+}
+
+bool save_tuning_profile(const std::string &path, const TuningProfile &profile) {
+	std::ofstream out(path);
+	out << "scene " << profile.scene << "\n"
+		<< "isa " << profile.isa << "\n"
+		<< "hardware_threads " << profile.hardware_threads << "\n"
+		<< "width " << profile.width << "\n"
+		<< "height " << profile.height << "\n"
+		<< "tile_size " << profile.tile_size << "\n"
+		<< "threads " << profile.threads << "\n";
+	if (profile.has_sample_split) {
+		out << "samples_base " << profile.samples_base << "\n"
+			<< "ambient_occlusion_samples " << profile.ambient_occlusion_samples << "\n"
+			<< "area_light_samples " << profile.area_light_samples << "\n";
+	}
+	return static_cast<bool>(out.flush());
+}
+
+bool tuning_matches(const TuningProfile &profile, const Config &cfg, std::string &reason) {
+	if (profile.isa != kernel_isa()) {
+		reason = "tuned for " + profile.isa;
+		return false;
+	}
+	if (profile.hardware_threads != static_cast<int>(std::thread::hardware_concurrency())) {
+		reason = "tuned for " + std::to_string(profile.hardware_threads) + " hardware threads";
+		return false;
+	}
+	if (profile.width != cfg.width || profile.height != cfg.height) {
+		reason = "tuned for " + std::to_string(profile.width) + "x" + std::to_string(profile.height);
+		return false;
+	}
+	return true;
+}
+
+static void set_area_light_samples(Scene &scene, int samples) {
+	for (auto &light : scene.area_light_data) {
+		light.u_samples = static_cast<short>(samples);
+		light.v_samples = static_cast<short>(samples);
+	}
+}
+
+void apply_tuning_profile(const TuningProfile &profile, Config &cfg, Scene &scene) {
+	cfg.tile_size = profile.tile_size;
+	cfg.threads = profile.threads;
+
+	if (!profile.has_sample_split) return;
+	cfg.samples_base = profile.samples_base;
+	cfg.ambient_occlusion_samples = profile.ambient_occlusion_samples;
+	if (profile.area_light_samples > 0) set_area_light_samples(scene, profile.area_light_samples);
+}
+
+struct Calibration {
+	double ms;
+	std::vector<glm::vec3> colors;
+};
+
+static Calibration calibrate(const SceneEntry &entry, const Scene &scene, const Config &cfg) {
+	auto cam = entry.make_camera();
+	init_camera(cam, cfg.width, cfg.height);
+
+	Calibration result{.colors = std::vector<glm::vec3>(cfg.width * cfg.height)};
+	std::vector<char> pixels(cfg.width * cfg.height * 3);
+	RenderingTask task{
+			.cfg = cfg,
+			.cam = cam,
+			.scene = scene,
+
+			.pixel_buffer = pixels.data(),
+			.color_buffer = result.colors.data(),
+	};
+	generate_image(task);
+
+	result.ms = task.duration_ms;
+	return result;
+}
+
+static double mse(const std::vector<glm::vec3> &colors, const std::vector<glm::vec3> &reference) {
+	double sum = 0;
+	for (auto i = 0; i < colors.size(); ++i) {
+		auto d = colors[i] - reference[i];
+		sum += glm::dot(d, d) / 3.0;
+	}
+	return sum / static_cast<double>(colors.size());
+}
+
+// tile size first at every hardware thread, then the thread count for that tile size. both only change speed, so a
+// single sample per pixel is enough to compare them
+static void tune_throughput(const SceneEntry &entry, const Scene &scene, const Config &cfg, TuningProfile &profile,
+							std::ostream &log) {
+	auto calibration = cfg;
+	calibration.samples_base = 1;
+	calibration.threads = render_thread_count(cfg);
+
+	auto best_ms = std::numeric_limits<double>::max();
+	for (auto tile_size : kTileSizes) {
+		calibration.tile_size = tile_size;
+		auto ms = calibrate(entry, scene, calibration).ms;
+		log << "tile_size " << tile_size << " threads " << calibration.threads << ": " << ms << "ms" << std::endl;
+		if (ms < best_ms) {
+			best_ms = ms;
+			profile.tile_size = tile_size;
+		}
+	}
+
+	calibration.tile_size = profile.tile_size;
+	profile.threads = calibration.threads;
+	auto hardware_threads = render_thread_count(Config{});
+	for (auto threads = 1; threads < hardware_threads; threads *= 2) {
+		calibration.threads = threads;
+		auto ms = calibrate(entry, scene, calibration).ms;
+		log << "tile_size " << profile.tile_size << " threads " << threads << ": " << ms << "ms" << std::endl;
+		if (ms < best_ms) {
+			best_ms = ms;
+			profile.threads = threads;
+		}
+	}
+}
+
+// a monte carlo estimate needs time proportional to 1 / mse to reach an error, so ms * mse is what a setting costs
+// at equal error. the split between light and ambient occlusion samples is picked by that cost one parameter at a
+// time, then samples_base is the lowest that brings it back to the error of the configured split
+static void tune_sample_split(const SceneEntry &entry, const Scene &scene, const Config &cfg, TuningProfile &profile,
+							  std::ostream &log) {
+	auto calibration = cfg;
+	calibration.width = kCalibrationSize;
+	calibration.height = kCalibrationSize * cfg.height / glm::max(cfg.width, 1);
+	calibration.tile_size = glm::min(profile.tile_size, kCalibrationSize / 2);
+	calibration.threads = profile.threads;
+
+	auto reference_cfg = calibration;
+	reference_cfg.samples_base = glm::max(kReferenceSamplesBase, cfg.samples_base * 2);
+	if (cfg.ambient_occlusion_samples > 0) reference_cfg.ambient_occlusion_samples = kReferenceAmbientOcclusionSamples;
+	auto reference_scene = scene;
+	set_area_light_samples(reference_scene, kReferenceAreaLightSamples);
+	auto reference = calibrate(entry, reference_scene, reference_cfg);
+	log << "reference: " << reference.ms << "ms" << std::endl;
+
+	auto light_samples = scene.area_light_data.empty() ? 0 : static_cast<int>(scene.area_light_data.front().u_samples);
+	auto candidate_scene = scene;
+
+	auto measure = [&](int samples_base, int ao, int light) {
+		auto candidate = calibration;
+		candidate.samples_base = samples_base;
+		candidate.ambient_occlusion_samples = ao;
+		if (light > 0) set_area_light_samples(candidate_scene, light);
+
+		auto result = calibrate(entry, candidate_scene, candidate);
+		auto error = mse(result.colors, reference.colors);
+		log << "samples_base " << samples_base << " ao " << ao << " area_light " << light << ": " << result.ms
+			<< "ms mse " << error << " cost " << result.ms * error << std::endl;
+		return std::make_pair(result.ms, error);
+	};
+
+	auto [base_ms, base_error] = measure(cfg.samples_base, cfg.ambient_occlusion_samples, light_samples);
+	auto best_cost = base_ms * base_error;
+	profile.ambient_occlusion_samples = cfg.ambient_occlusion_samples;
+	profile.area_light_samples = light_samples;
+
+	if (cfg.ambient_occlusion_samples > 0) {
+		for (auto ao : kAmbientOcclusionSamples) {
+			if (ao == cfg.ambient_occlusion_samples) continue;
+			auto [ms, error] = measure(cfg.samples_base, ao, light_samples);
+			if (ms * error < best_cost) {
+				best_cost = ms * error;
+				profile.ambient_occlusion_samples = ao;
+			}
+		}
+	}
+
+	if (light_samples > 0) {
+		for (auto light : kAreaLightSamples) {
+			if (light == light_samples) continue;
+			auto [ms, error] = measure(cfg.samples_base, profile.ambient_occlusion_samples, light);
+			if (ms * error < best_cost) {
+				best_cost = ms * error;
+				profile.area_light_samples = light;
+			}
+		}
+	}
+
+	// the configured split stays unless a cheaper one reaches its error
+	auto found = false;
+	for (auto samples_base = 1; samples_base <= cfg.samples_base * 2 && !found; ++samples_base) {
+		auto [ms, error] = measure(samples_base, profile.ambient_occlusion_samples, profile.area_light_samples);
+		if (error > base_error) continue;
+
+		found = ms < base_ms;
+		profile.samples_base = samples_base;
+		if (!found) break;
+	}
+	if (!found) {
+		profile.samples_base = cfg.samples_base;
+		profile.ambient_occlusion_samples = cfg.ambient_occlusion_samples;
+		profile.area_light_samples = light_samples;
+	}
+	profile.has_sample_split = true;
+}
+
+TuningProfile run_autotune(const SceneEntry &entry, const Config &cfg, TuningObjective objective, std::ostream &log) {
+	Scene scene;
+	entry.make_scene(scene);
+
+	auto profile = TuningProfile{
+			.scene = entry.name,
+			.isa = kernel_isa(),
+			.hardware_threads = static_cast<int>(std::thread::hardware_concurrency()),
+			.width = cfg.width,
+			.height = cfg.height,
+	};
+
+	tune_throughput(entry, scene, cfg, profile, log);
+	if (objective == TuningObjective::kEqualError) tune_sample_split(entry, scene, cfg, profile, log);
+	return profile;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include "config.h"
+#include "scene.h"
+#include "scenes.h"
+
+enum class TuningObjective {
+	kThroughput, // tile size and thread count, the image stays the same
+	kEqualError, // also the sample split that reaches the configured error for the least time
+};
+
+// what autotune found for one scene on one machine
+struct TuningProfile {
+	std::string scene;
+	std::string isa; // kernel_isa() of the machine it was tuned on
+	int hardware_threads = 0;
+
+	int width = 0; // image size tile_size and threads were tuned for
+	int height = 0;
+	int tile_size = 0;
+	int threads = 0;
+
+	// only part of profiles tuned for equal error
+	bool has_sample_split = false;
+	int samples_base = 0;
+	int ambient_occlusion_samples = 0;
+	int area_light_samples = 0; // u and v samples of every area light, 0 keeps what the scene has
+};
+
+// profile that renders of scene pick up by default
+std::string default_tuning_path(const std::string &scene);
+
+bool load_tuning_profile(const std::string &path, TuningProfile &profile);
+bool save_tuning_profile(const std::string &path, const TuningProfile &profile);
+
+// false with the reason if profile was tuned on another kind of machine or for another image size than cfg's
+bool tuning_matches(const TuningProfile &profile, const Config &cfg, std::string &reason);
+
+void apply_tuning_profile(const TuningProfile &profile, Config &cfg, Scene &scene);
+
+// runs short calibration renders of entry around cfg and logs every candidate it measured
+TuningProfile run_autotune(const SceneEntry &entry, const Config &cfg, TuningObjective objective, std::ostream &log);